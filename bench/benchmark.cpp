@@ -0,0 +1,372 @@
+#include <chrono>
+#include <random>
+#include <string>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include "../include/registry.h"
+
+/// Benchmarks of the registry hot paths
+///
+/// Every measurement is printed as one JSON object per line:
+/// {"benchmark":"for_each","entities":100000,"mix":"TV","fragmentation":0.5,"ns_per_entity":1.9,"bytes_per_entity":0}
+///
+/// Usage: reflecs_benchmark [max_entities]
+
+using namespace reflecs::component_reflection;
+
+#pragma region COMPONENTS
+
+struct transform
+{
+	transform(float x, float y, float w, float h) : x(x), y(y), w(w), h(h) {}
+
+	float x, y, w, h;
+};
+
+template<> struct reflecs::component_reflection::get_member_count<transform> { static const int count = 4; };
+template<> struct reflecs::component_reflection::get_type<transform, 0> { using type = float; };
+template<> struct reflecs::component_reflection::get_type<transform, 1> { using type = float; };
+template<> struct reflecs::component_reflection::get_type<transform, 2> { using type = float; };
+template<> struct reflecs::component_reflection::get_type<transform, 3> { using type = float; };
+template<> inline typename get_pointer_to_member_type<transform, 0>::type reflecs::component_reflection::get_pointer_to_member<transform, 0>() { return &transform::x; }
+template<> inline typename get_pointer_to_member_type<transform, 1>::type reflecs::component_reflection::get_pointer_to_member<transform, 1>() { return &transform::y; }
+template<> inline typename get_pointer_to_member_type<transform, 2>::type reflecs::component_reflection::get_pointer_to_member<transform, 2>() { return &transform::w; }
+template<> inline typename get_pointer_to_member_type<transform, 3>::type reflecs::component_reflection::get_pointer_to_member<transform, 3>() { return &transform::h; }
+
+template<>
+struct component_handle<transform>
+{
+	component_manager<transform>& pool;
+	component_instance instance;
+
+	component_handle(component_manager<transform>& pool, component_instance instance) : pool(pool), instance(instance) {}
+
+	inline float& x() { return pool.get_member_buffer<0>(instance); }
+	inline float& y() { return pool.get_member_buffer<1>(instance); }
+	inline float& w() { return pool.get_member_buffer<2>(instance); }
+	inline float& h() { return pool.get_member_buffer<3>(instance); }
+
+	inline const float& x() const { return pool.get_member_value<0>(instance); }
+	inline const float& y() const { return pool.get_member_value<1>(instance); }
+	inline const float& w() const { return pool.get_member_value<2>(instance); }
+	inline const float& h() const { return pool.get_member_value<3>(instance); }
+};
+
+struct velocity
+{
+	velocity(float x, float y) : x(x), y(y) {}
+
+	float x, y;
+};
+
+template<> struct reflecs::component_reflection::get_member_count<velocity> { static const int count = 2; };
+template<> struct reflecs::component_reflection::get_type<velocity, 0> { using type = float; };
+template<> struct reflecs::component_reflection::get_type<velocity, 1> { using type = float; };
+template<> inline typename get_pointer_to_member_type<velocity, 0>::type reflecs::component_reflection::get_pointer_to_member<velocity, 0>() { return &velocity::x; }
+template<> inline typename get_pointer_to_member_type<velocity, 1>::type reflecs::component_reflection::get_pointer_to_member<velocity, 1>() { return &velocity::y; }
+
+template<>
+struct component_handle<velocity>
+{
+	component_manager<velocity>& pool;
+	component_instance instance;
+
+	component_handle(component_manager<velocity>& pool, component_instance instance) : pool(pool), instance(instance) {}
+
+	inline float& x() { return pool.get_member_buffer<0>(instance); }
+	inline float& y() { return pool.get_member_buffer<1>(instance); }
+
+	inline const float& x() const { return pool.get_member_value<0>(instance); }
+	inline const float& y() const { return pool.get_member_value<1>(instance); }
+};
+
+struct color_component
+{
+	color_component(char r, char g, char b, char a) : r(r), g(g), b(b), a(a) {}
+
+	char r, g, b, a;
+};
+
+template<> struct reflecs::component_reflection::get_member_count<color_component> { static const int count = 4; };
+template<> struct reflecs::component_reflection::get_type<color_component, 0> { using type = char; };
+template<> struct reflecs::component_reflection::get_type<color_component, 1> { using type = char; };
+template<> struct reflecs::component_reflection::get_type<color_component, 2> { using type = char; };
+template<> struct reflecs::component_reflection::get_type<color_component, 3> { using type = char; };
+template<> inline typename get_pointer_to_member_type<color_component, 0>::type reflecs::component_reflection::get_pointer_to_member<color_component, 0>() { return &color_component::r; }
+template<> inline typename get_pointer_to_member_type<color_component, 1>::type reflecs::component_reflection::get_pointer_to_member<color_component, 1>() { return &color_component::g; }
+template<> inline typename get_pointer_to_member_type<color_component, 2>::type reflecs::component_reflection::get_pointer_to_member<color_component, 2>() { return &color_component::b; }
+template<> inline typename get_pointer_to_member_type<color_component, 3>::type reflecs::component_reflection::get_pointer_to_member<color_component, 3>() { return &color_component::a; }
+
+template<>
+struct component_handle<color_component>
+{
+	component_manager<color_component>& pool;
+	component_instance instance;
+
+	component_handle(component_manager<color_component>& pool, component_instance instance) : pool(pool), instance(instance) {}
+
+	inline char& r() { return pool.get_member_buffer<0>(instance); }
+	inline char& g() { return pool.get_member_buffer<1>(instance); }
+	inline char& b() { return pool.get_member_buffer<2>(instance); }
+	inline char& a() { return pool.get_member_buffer<3>(instance); }
+
+	inline const char& r() const { return pool.get_member_value<0>(instance); }
+	inline const char& g() const { return pool.get_member_value<1>(instance); }
+	inline const char& b() const { return pool.get_member_value<2>(instance); }
+	inline const char& a() const { return pool.get_member_value<3>(instance); }
+};
+
+#pragma endregion
+
+using world = registry<transform, velocity, color_component>;
+using bench_clock = std::chrono::steady_clock;
+
+/// Plain array-of-structs layout used as the baseline
+struct aos_entity
+{
+	transform t;
+	velocity v;
+	color_component c;
+	bool has_velocity;
+	bool has_color;
+};
+
+/// Keeps the optimizer from throwing away benchmark results
+static volatile float g_sink;
+
+/// Component mix of the spawned entities: T = transform, V = velocity, C = color
+enum class mix
+{
+	t,
+	tv,
+	tvc
+};
+
+static const char* mix_name(mix m)
+{
+	switch (m)
+	{
+	case mix::t: return "T";
+	case mix::tv: return "TV";
+	default: return "TVC";
+	}
+}
+
+/// Bytes currently allocated from the heap; 0 where the C library does not tell
+static size_t heap_bytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static void report(const char* benchmark, size_t entities, mix m, double fragmentation, double ns_per_entity, double bytes_per_entity)
+{
+	std::printf("{\"benchmark\":\"%s\",\"entities\":%zu,\"mix\":\"%s\",\"fragmentation\":%.2f,\"ns_per_entity\":%.3f,\"bytes_per_entity\":%.1f}\n",
+		benchmark, entities, mix_name(m), fragmentation, ns_per_entity, bytes_per_entity);
+	std::fflush(stdout);
+}
+
+/**
+ * @brief Times a function; returns the elapsed nanoseconds
+ * @param function Function to time
+*/
+template<typename F>
+static double time_ns(F&& function)
+{
+	auto start = bench_clock::now();
+	function();
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count());
+}
+
+/**
+ * @brief Adds the components of the mix to an entity
+ * @param w Registry
+ * @param e Entity's id
+ * @param m Component mix
+*/
+static void add_mix(world& w, entity_id e, mix m)
+{
+	w.add<transform>(e, 1.0f, 2.0f, 50.0f, 50.0f);
+	if (m != mix::t)
+	{
+		w.add<velocity>(e, 1.0f, 0.5f);
+	}
+	if (m == mix::tvc)
+	{
+		w.add<color_component>(e, 1, 2, 3, 4);
+	}
+}
+
+/**
+ * @brief Spawns entities and scrambles the storage: a fraction of them is destroyed
+ *		  in random order and spawned again, which shuffles the pools and buckets
+ * @param w Registry
+ * @param count Number of entities
+ * @param m Component mix
+ * @param fragmentation Fraction of entities to respawn
+ * @return Ids of the live entities
+*/
+static std::vector<entity_id> spawn(world& w, size_t count, mix m, double fragmentation)
+{
+	std::vector<entity_id> e_ids;
+	e_ids.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		entity_id e = w.create_entity();
+		add_mix(w, e, m);
+		e_ids.push_back(e);
+	}
+
+	std::mt19937 rng(42);
+	std::shuffle(e_ids.begin(), e_ids.end(), rng);
+
+	size_t respawned = size_t(double(count) * fragmentation);
+	for (size_t i = 0; i < respawned; ++i)
+	{
+		w.destroy(e_ids[i]);
+	}
+	for (size_t i = 0; i < respawned; ++i)
+	{
+		e_ids[i] = w.create_entity();
+		add_mix(w, e_ids[i], m);
+	}
+	std::shuffle(e_ids.begin(), e_ids.end(), rng);
+	return e_ids;
+}
+
+/**
+ * @brief Runs the structural and iteration benchmarks of the registry for one configuration
+ * @param count Number of entities
+ * @param m Component mix
+ * @param fragmentation Fraction of entities respawned before measuring
+*/
+static void bench_registry(size_t count, mix m, double fragmentation)
+{
+	size_t repetitions = std::max<size_t>(1, 200000 / count);
+	double create_ns = 1e300, add_ns = 1e300, remove_ns = 1e300, destroy_ns = 1e300, unpack_ns = 1e300, for_each_ns = 1e300, chunk_ns = 1e300;
+	double bytes = 0;
+
+	for (size_t repetition = 0; repetition < repetitions; ++repetition)
+	{
+		/// create_entity and add on a fresh registry
+		{
+			size_t heap_before = heap_bytes();
+			world w(count);
+			std::vector<entity_id> e_ids(count);
+
+			create_ns = std::min(create_ns, time_ns([&]() { for (size_t i = 0; i < count; ++i) e_ids[i] = w.create_entity(); }) / count);
+			add_ns = std::min(add_ns, time_ns([&]() { for (entity_id e : e_ids) add_mix(w, e, m); }) / count);
+
+			bytes = (double(heap_bytes()) - double(heap_before)) / count;
+		}
+
+		/// remaining operations on a scrambled registry
+		world w(count);
+		std::vector<entity_id> e_ids = spawn(w, count, m, fragmentation);
+
+		unpack_ns = std::min(unpack_ns, time_ns([&]()
+			{
+				float sum = 0.0f;
+				for (entity_id e : e_ids)
+				{
+					const auto [t] = w.unpack<transform>(e);
+					sum += t.x();
+				}
+				g_sink = sum;
+			}) / count);
+
+		for_each_ns = std::min(for_each_ns, time_ns([&]()
+			{
+				w.for_each<transform>([](entity_id, component_handle<transform> t)
+					{
+						t.x() += 1.0f;
+						t.y() += 1.0f;
+					});
+			}) / count);
+
+		chunk_ns = std::min(chunk_ns, time_ns([&]()
+			{
+				w.for_each_chunk<transform>([](float* x, float* y, float*, float*, size_t n)
+					{
+						for (size_t i = 0; i < n; ++i)
+						{
+							x[i] += 1.0f;
+							y[i] += 1.0f;
+						}
+					});
+			}) / count);
+
+		remove_ns = std::min(remove_ns, time_ns([&]() { for (entity_id e : e_ids) w.remove<transform>(e); }) / count);
+		destroy_ns = std::min(destroy_ns, time_ns([&]() { for (entity_id e : e_ids) w.destroy(e); }) / count);
+	}
+
+	report("create_entity", count, m, fragmentation, create_ns, bytes);
+	report("add", count, m, fragmentation, add_ns, bytes);
+	report("unpack", count, m, fragmentation, unpack_ns, bytes);
+	report("for_each", count, m, fragmentation, for_each_ns, bytes);
+	report("for_each_chunk", count, m, fragmentation, chunk_ns, bytes);
+	report("remove", count, m, fragmentation, remove_ns, bytes);
+	report("destroy", count, m, fragmentation, destroy_ns, bytes);
+}
+
+/**
+ * @brief Same workload on a std::vector of structs
+ * @param count Number of entities
+ * @param m Component mix
+*/
+static void bench_aos(size_t count, mix m)
+{
+	size_t repetitions = std::max<size_t>(1, 200000 / count);
+	double create_ns = 1e300, for_each_ns = 1e300;
+	double bytes = 0;
+
+	for (size_t repetition = 0; repetition < repetitions; ++repetition)
+	{
+		size_t heap_before = heap_bytes();
+		std::vector<aos_entity> entities;
+
+		create_ns = std::min(create_ns, time_ns([&]()
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					entities.push_back({ transform(1.0f, 2.0f, 50.0f, 50.0f), velocity(1.0f, 0.5f), color_component(1, 2, 3, 4), m != mix::t, m == mix::tvc });
+				}
+			}) / count);
+		bytes = (double(heap_bytes()) - double(heap_before)) / count;
+
+		for_each_ns = std::min(for_each_ns, time_ns([&]()
+			{
+				for (aos_entity& e : entities)
+				{
+					e.t.x += 1.0f;
+					e.t.y += 1.0f;
+				}
+			}) / count);
+		g_sink = entities[count / 2].t.x;
+	}
+
+	report("aos_create", count, m, 0.0, create_ns, bytes);
+	report("aos_for_each", count, m, 0.0, for_each_ns, bytes);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t max_entities = argc > 1 ? std::stoull(argv[1]) : 1000000;
+
+	for (size_t count = 1000; count <= max_entities; count *= 10)
+	{
+		for (mix m : { mix::t, mix::tv, mix::tvc })
+		{
+			for (double fragmentation : { 0.0, 0.5, 1.0 })
+			{
+				bench_registry(count, m, fragmentation);
+			}
+			bench_aos(count, m);
+		}
+	}
+	return 0;
+}
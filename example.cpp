@@ -1,5 +1,6 @@
 #include <random>
 #include "include/registry.h"
+#include "include/scheduler.h"
 
 using namespace reflecs::component_reflection;
 
@@ -26,7 +27,7 @@ using namespace reflecs::component_reflection;
 
     /// IMPORTANT: The following specializations are required for the component helpers to work
 
-    template<> struct get_member_count<transform>
+    template<> struct reflecs::component_reflection::get_member_count<transform>
     {
         static const int count = 4; /// Number of fields in the component
     };
@@ -36,22 +37,22 @@ using namespace reflecs::component_reflection;
 	/// type is the type of the member at the specified index
 	/// e.g. get_type<transform, 0>::type is x which is a float
 
-    template<> struct get_type<transform, 0>
+    template<> struct reflecs::component_reflection::get_type<transform, 0>
     {
         using type = float;
     };
 
-    template<> struct get_type<transform, 1>
+    template<> struct reflecs::component_reflection::get_type<transform, 1>
     {
         using type = float;
     };
 
-    template<> struct get_type<transform, 2>
+    template<> struct reflecs::component_reflection::get_type<transform, 2>
     {
         using type = float;
     };
 
-    template<> struct get_type<transform, 3>
+    template<> struct reflecs::component_reflection::get_type<transform, 3>
     {
         using type = float;
     };
@@ -78,11 +79,19 @@ using namespace reflecs::component_reflection;
         {}
         
 		/// Define methods to access the members of the component
-		/// The get_member_buffer function is used to get the buffer of the member at the specified index
+		/// The get_member_buffer function is used to get the buffer of the member at the specified index;
+		/// it counts as a write for change tracking and range indices
         inline float& x() { return pool.get_member_buffer<0>(instance); }
         inline float& y() { return pool.get_member_buffer<1>(instance); }
         inline float& w() { return pool.get_member_buffer<2>(instance); }
         inline float& h() { return pool.get_member_buffer<3>(instance); }
+
+		/// Const accessors read through get_member_value, which leaves the instance unmarked;
+		/// systems that only read take the handle as const
+        inline const float& x() const { return pool.get_member_value<0>(instance); }
+        inline const float& y() const { return pool.get_member_value<1>(instance); }
+        inline const float& w() const { return pool.get_member_value<2>(instance); }
+        inline const float& h() const { return pool.get_member_value<3>(instance); }
     };
 
 	/// Other components can be defined in a similar way
@@ -96,17 +105,17 @@ using namespace reflecs::component_reflection;
         float x, y;
     };
 
-    template<> struct get_member_count<velocity>
+    template<> struct reflecs::component_reflection::get_member_count<velocity>
     {
         static const int count = 2;
     };
 
-    template<> struct get_type<velocity, 0>
+    template<> struct reflecs::component_reflection::get_type<velocity, 0>
     {
         using type = float;
     };
 
-    template<> struct get_type<velocity, 1>
+    template<> struct reflecs::component_reflection::get_type<velocity, 1>
     {
         using type = float;
     };
@@ -127,6 +136,9 @@ using namespace reflecs::component_reflection;
 
         inline float& x() { return pool.get_member_buffer<0>(instance); }
         inline float& y() { return pool.get_member_buffer<1>(instance); }
+
+        inline const float& x() const { return pool.get_member_value<0>(instance); }
+        inline const float& y() const { return pool.get_member_value<1>(instance); }
     };
 
     struct color_component
@@ -141,27 +153,27 @@ using namespace reflecs::component_reflection;
         char r, g, b, a;
     };
 
-    template<> struct get_member_count<color_component>
+    template<> struct reflecs::component_reflection::get_member_count<color_component>
     {
         static const int count = 4;
     };
 
-    template<> struct get_type<color_component, 0>
+    template<> struct reflecs::component_reflection::get_type<color_component, 0>
     {
         using type = char;
     };
 
-    template<> struct get_type<color_component, 1>
+    template<> struct reflecs::component_reflection::get_type<color_component, 1>
     {
         using type = char;
     };
 
-    template<> struct get_type<color_component, 2>
+    template<> struct reflecs::component_reflection::get_type<color_component, 2>
     {
         using type = char;
     };
 
-    template<> struct get_type<color_component, 3>
+    template<> struct reflecs::component_reflection::get_type<color_component, 3>
     {
         using type = char;
     };
@@ -186,6 +198,11 @@ using namespace reflecs::component_reflection;
         inline char& g() { return pool.get_member_buffer<1>(instance); }
         inline char& b() { return pool.get_member_buffer<2>(instance); }
         inline char& a() { return pool.get_member_buffer<3>(instance); }
+
+        inline const char& r() const { return pool.get_member_value<0>(instance); }
+        inline const char& g() const { return pool.get_member_value<1>(instance); }
+        inline const char& b() const { return pool.get_member_value<2>(instance); }
+        inline const char& a() const { return pool.get_member_value<3>(instance); }
     };
 #pragma endregion
 
@@ -208,44 +225,71 @@ void generateEntityWithRectangle(registry<transform, velocity, color_component>&
 
 int main(int argc, char* argv[])
 {
-    registry<transform, velocity, color_component> registry;
+    using namespace reflecs::scheduling;
+    using world = registry<transform, velocity, color_component>;
+
+    world registry;
+    thread_pool pool; /// Reused every frame; spawns one worker per hardware thread
 
     for (size_t i = 0; i < g_max_entities; ++i) 
     {
         generateEntityWithRectangle(registry);
     }
+
+    /// Systems declare what they read and write; damping and fading touch different components and run at the same time
+    scheduler<transform, velocity, color_component> systems(registry, pool);
+
+    systems.add<reads<>, writes<velocity>>("damping", [&pool](world& registry)
+        {
+            registry.par_for_each<velocity>(pool, [](entity_id _, component_handle<velocity> velocity)
+                {
+                    velocity.x() *= 0.98f;
+                    velocity.y() *= 0.98f;
+                });
+        });
+
+    systems.add<reads<>, writes<color_component>>("fading", [&pool](world& registry)
+        {
+            registry.par_for_each<color_component>(pool, [](entity_id _, component_handle<color_component> color)
+                {
+                    color.a() = color.a() > 0 ? color.a() - 1 : 0;
+                });
+        });
+
+    systems.add<reads<>, writes<transform, velocity>>("movement", [&pool](world& registry)
+        {
+            registry.par_for_each<transform, velocity>(pool, [](entity_id _, component_handle<transform> transform, component_handle<velocity> velocity)
+                {
+                    transform.x() += velocity.x();
+                    transform.y() += velocity.y();
+
+                    // Reverse direction if the entity hits the left or right bounds
+                    if (transform.x() < 0) {
+                        transform.x() = 0;
+                        velocity.x() = -velocity.x(); // Reverse horizontal direction
+                    }
+                    else if (transform.x() + transform.w() > 800) {
+                        transform.x() = 800 - transform.w();
+                        velocity.x() = -velocity.x(); // Reverse horizontal direction
+                    }
+
+                    // Reverse direction if the entity hits the top or bottom bounds
+                    if (transform.y() < 0) {
+                        transform.y() = 0;
+                        velocity.y() = -velocity.y(); // Reverse vertical direction
+                    }
+                    else if (transform.y() + transform.h() > 600) {
+                        transform.y() = 600 - transform.h();
+                        velocity.y() = -velocity.y(); // Reverse vertical direction
+                    }
+                });
+        });
     
     bool running = true;
 
     while (running) 
     {
-        registry.for_each<transform, velocity>([](entity_id _, component_handle<transform> transform, component_handle<velocity> velocity)
-            {
-                velocity.x() *= 0.98f;
-                velocity.y() *= 0.98f;
-                transform.x() += velocity.x();
-                transform.y() += velocity.y();
-
-                // Reverse direction if the entity hits the left or right bounds
-                if (transform.x() < 0) {
-                    transform.x() = 0;
-                    velocity.x() = -velocity.x(); // Reverse horizontal direction
-                }
-                else if (transform.x() + transform.w() > 800) {
-                    transform.x() = 800 - transform.w();
-                    velocity.x() = -velocity.x(); // Reverse horizontal direction
-                }
-
-                // Reverse direction if the entity hits the top or bottom bounds
-                if (transform.y() < 0) {
-                    transform.y() = 0;
-                    velocity.y() = -velocity.y(); // Reverse vertical direction
-                }
-                else if (transform.y() + transform.h() > 600) {
-                    transform.y() = 600 - transform.h();
-                    velocity.y() = -velocity.y(); // Reverse vertical direction
-                }
-            });
+        systems.run();
 
 		/// Your rendering code here
     }
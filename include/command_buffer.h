@@ -0,0 +1,102 @@
+#pragma once
+#include "common.h"
+#include "utility.h"
+
+template<typename ... Cs>
+class registry;
+
+
+/**
+ * @class command_buffer
+ *
+ * @brief Records structural changes (add, remove, destroy) so they can be applied later
+ *		  in one batch by registry::flush(). Used to change entities while they are being iterated.
+ *		  Every thread records into its own buffer, see registry::commands(). Adds and removes
+ *		  carry the order they were recorded in, so flush() replays them in that order.
+ *
+ * @tparam Cs Components registered in the registry
+ */
+template<typename ... Cs>
+class command_buffer
+{
+private:
+	friend class registry<Cs...>;
+
+	/// Constructed component waiting to be added
+	template<typename C>
+	struct recorded_add
+	{
+		template<typename ... Args>
+		recorded_add(entity_id id, std::uint64_t order, Args&& ... args)
+			: e_id(id)
+			, sequence(order)
+			, component(std::forward<Args>(args)...)
+		{}
+
+		entity_id e_id;
+		std::uint64_t sequence;
+		C component;
+	};
+
+	std::tuple<std::vector<recorded_add<Cs>>...> m_adds; // Components waiting to be added, per component type
+	std::array<std::vector<std::pair<entity_id, std::uint64_t>>, sizeof...(Cs)> m_removes; // Entities waiting to lose a component and the sequence of the command, per component type
+	std::vector<entity_id> m_destroys; // Entities waiting to be destroyed
+	std::uint64_t m_sequence = 0; // Sequence of the next add or remove
+
+public:
+
+	/**
+	* @brief Records adding a component; the component is constructed right away
+	*
+	* @tparam C Component
+	* @param e_id Entity's id
+	* @param args Plain component data
+	*/
+	template<typename C, typename ... Args>
+	void add(entity_id e_id, Args&& ... args)
+	{
+		std::get<std::vector<recorded_add<C>>>(m_adds).emplace_back(e_id, m_sequence++, std::forward<Args>(args)...);
+	}
+
+	/**
+	* @brief Records removing a component
+	*
+	* @tparam C Component
+	* @param e_id Entity's id
+	*/
+	template<typename C>
+	void remove(entity_id e_id)
+	{
+		m_removes[reflecs::type_utils::get_component_type_id<C, Cs...>()].emplace_back(e_id, m_sequence++);
+	}
+
+	/**
+	* @brief Records destroying an entity
+	*
+	* @param e_id Entity's id
+	*/
+	void destroy(entity_id e_id)
+	{
+		m_destroys.push_back(e_id);
+	}
+
+	/// Whether nothing was recorded
+	bool empty() const
+	{
+		bool adds_empty = std::apply([](const auto& ... adds) { return (adds.empty() && ...); }, m_adds);
+		bool removes_empty = std::all_of(m_removes.begin(), m_removes.end(), [](const auto& removes) { return removes.empty(); });
+		return adds_empty && removes_empty && m_destroys.empty();
+	}
+
+	/// Drops every recorded command
+	void clear()
+	{
+		std::apply([](auto& ... adds) { (adds.clear(), ...); }, m_adds);
+		for (auto& removes : m_removes)
+		{
+			removes.clear();
+		}
+		m_destroys.clear();
+		m_sequence = 0;
+	}
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <unordered_map>
 #include <array>
@@ -9,10 +10,15 @@
 #include <bitset>
 #include <vector>
 #include <optional>
+#include <tuple>
 
-using entity_id = std::size_t;
+using entity_id = std::size_t; // Slot index in the low 32 bits, slot generation in the high 32 bits
 using component_instance = std::size_t;
 
-constexpr size_t g_max_entities = 50000;
-constexpr size_t g_container_size = g_max_entities + 1;
+constexpr entity_id g_invalid_entity = -1; // Returned when no entity could be created
+constexpr size_t g_entity_index_bits = 32; // Number of bits of an entity_id holding the slot index
+
+constexpr size_t g_max_entities = 50000; // Default entity capacity of a registry
+constexpr size_t g_page_size = 4096; // Number of elements in a storage page; must be a power of two
+constexpr size_t g_default_grain_size = 1024; // Default number of entities processed by a single parallel task
 
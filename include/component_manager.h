@@ -1,13 +1,20 @@
 #pragma once
 
-#include "Common.h"
+#include "common.h"
 #include "utility.h"
+#include "paged_array.h"
+#include "sparse_map.h"
+#include "page_allocator.h"
+#include "snapshot.h"
+#include <mutex>
 
 
 /**
  * @class component_pool
  *
- * @brief Represents the compotent pool data
+ * @brief Represents the compotent pool data. Instances are stored in pages of g_page_size,
+ *		  which are split into blocks of the component layout's block width; inside a block
+ *		  every field occupies its own contiguous column.
  *
  * @tparam C Component type
  * @tparam elements Number of elements in the component
@@ -16,13 +23,65 @@ template<typename C, size_t elements>
 struct component_pool
 {
 	size_t size = 1; // first available element in the array starts at 1; 0 reserved for error handling
-	void* buffer[elements];
+	size_t max_pages = 0; // Number of pages needed to hold the capacity
+	size_t page_bytes = 0; // Byte size of a single page
+	size_t block_bytes = 0; // Byte size of a block inside a page
+	size_t offsets[elements]; // Byte offset of every field's column inside a block
+	std::vector<void*> pages; // Allocated pages; grows and shrinks with size
+	size_t adopted_pages = 0; // Leading pages that live inside a snapshot mapping and are not owned by the allocator
+	std::shared_ptr<reflecs::snapshot::mapping> mapping; // Keeps the adopted pages alive
+	std::unique_ptr<reflecs::storage::page_allocator> allocator; // Provides the remaining pages
+	size_t version_offset = 0; // Byte offset of the version column inside a page; only with change tracking
+	std::unique_ptr<std::atomic<std::uint32_t>[]> page_versions; // Newest version stamped into each page; only with change tracking
+
+	/**
+	 * @brief Gives every page that is not adopted back to the allocator, newest first
+	 * @param teardown Whether the pool is destroyed; persistent allocators then keep the contents
+	 */
+	void release_pages(bool teardown = false)
+	{
+		while (pages.size() > adopted_pages)
+		{
+			if (teardown)
+			{
+				allocator->detach(pages.back());
+			}
+			else
+			{
+				allocator->release(pages.back());
+			}
+			pages.pop_back();
+		}
+		pages.clear();
+		adopted_pages = 0;
+		mapping.reset();
+	}
+
 	~component_pool()
 	{
-		delete buffer[0];
+		release_pages(true);
 	}
 };
 
+/**
+ * @class field_index
+ *
+ * @brief Entities sorted by the value of an indexed field, for range queries. Any write to the
+ *		  pool marks the index stale and it is rebuilt on its next use.
+ *
+ * @tparam T Field type
+ */
+template<typename T>
+struct field_index
+{
+	std::vector<std::pair<T, size_t>> entries; // Field value and entity slot, sorted by value
+	std::atomic<bool> stale = true;
+	std::mutex rebuild_mutex; // Lets several readers use the index at once
+};
+
+/// Placeholder for fields without an index
+struct no_field_index {};
+
 /**
  * @class component_handle
  *
@@ -38,7 +97,8 @@ class component_handle;
  *
  * @brief This class is responsible for pooling the fields of an component,
  *		  assigning a free component instance to an entity and also removing
- *		  it from this instance
+ *		  it from this instance. Entities are mapped to instances through a paged_array,
+ *		  or through a sparse_map if the component uses the sparse_storage policy.
  *
  * @tparam C Component type
  */
@@ -47,22 +107,68 @@ class component_manager
 {
 private:
 	static constexpr size_t member_count = reflecs::component_reflection::get_member_count<C>::count;
+	static constexpr bool tracks_changes = reflecs::component_reflection::track_changes<C>::value;
+	static constexpr size_t block_width = reflecs::component_reflection::layout<C>::type::block_width; // Instances per block
+	static constexpr bool sparse = std::is_same<typename reflecs::component_reflection::storage_policy<C>::type, reflecs::component_reflection::sparse_storage>::value;
+	static_assert(member_count > 0, "Tags have no pool; the registry stores them in tag_manager");
+
+	template<typename Indices>
+	struct field_indices_of;
+
+	template<size_t ... indices>
+	struct field_indices_of<std::index_sequence<indices...>>
+	{
+		using type = std::tuple<std::conditional_t<reflecs::component_reflection::range_index<C, indices>::value,
+			field_index<typename reflecs::component_reflection::get_type<C, indices>::type>, no_field_index>...>;
+	};
+
+	using field_indices = field_indices_of<std::make_index_sequence<member_count>>;
+	static constexpr bool has_range_index = reflecs::component_reflection::has_range_index<C>::value;
 	component_pool<C, member_count> m_component_pool;
-	std::vector<component_instance> m_entities_to_components;
+	std::uint32_t m_tick = 1; // Version stamped on written instances
+	std::conditional_t<sparse, sparse_map<component_instance>, paged_array<component_instance>> m_entities_to_components; // Indexed by entity slot
+	paged_array<entity_id> m_components_to_entities; // Dense reverse index; owner of every instance in the pool
+	typename field_indices::type m_field_indices; // Sorted index of every field with a range index
+	std::uint64_t m_revision = 0; // Bumped when instances are added, overwritten by add, removed or moved
 
 public:
 
-	component_manager()
-		: m_entities_to_components(g_max_entities)
+	/**
+	 * @brief Creates an empty pool; pages are allocated as components are added
+	 * @param capacity Maximum number of entities
+	*/
+	explicit component_manager(size_t capacity = g_max_entities)
+		: m_entities_to_components(capacity)
+		, m_components_to_entities(capacity + 1)
 	{
-		size_t packed_component_size = 0;
-		reflecs::constexpr_loop::execute<member_count, count_component_size_wrapper>(this, packed_component_size);
+		m_component_pool.max_pages = (capacity + 1 + g_page_size - 1) / g_page_size;
+		size_t block_bytes = 0;
+		size_t block_alignment = 1;
+		reflecs::constexpr_loop::execute<member_count, generate_offsets_wrapper>(this, block_bytes, block_alignment);
+
+		/// Keep the next block aligned for every field
+		m_component_pool.block_bytes = (block_bytes + block_alignment - 1) / block_alignment * block_alignment;
+		m_component_pool.page_bytes = m_component_pool.block_bytes * (g_page_size / block_width);
+		if constexpr (tracks_changes)
+		{
+			/// Versions are one more column of the page
+			size_t& page_bytes = m_component_pool.page_bytes;
+			page_bytes = (page_bytes + alignof(std::uint32_t) - 1) / alignof(std::uint32_t) * alignof(std::uint32_t);
+			m_component_pool.version_offset = page_bytes;
+			page_bytes += sizeof(std::uint32_t) * g_page_size;
 
-		size_t bytes = g_container_size * packed_component_size;
-		m_component_pool.buffer[0] = malloc(bytes);
-		reflecs::constexpr_loop::execute<member_count - 1, generate_buffers_wrapper>(this, m_component_pool.buffer, g_container_size);
+			m_component_pool.page_versions = std::make_unique<std::atomic<std::uint32_t>[]>(m_component_pool.max_pages);
+			for (size_t i = 0; i < m_component_pool.max_pages; ++i)
+			{
+				m_component_pool.page_versions[i].store(0, std::memory_order_relaxed);
+			}
+		}
+		m_component_pool.allocator = std::make_unique<reflecs::storage::heap_page_allocator>(m_component_pool.page_bytes);
 	}
 
+	component_manager(const component_manager&) = delete;
+	component_manager& operator=(const component_manager&) = delete;
+
 	/*
 	* @brief Adds the component to the field pools
 	*
@@ -71,25 +177,83 @@ public:
 	* @param args Arguments to pass to the constructor of the component
 	*/
 	template<typename ... Args>
-	component_instance& add(entity_id e_id, Args&& ... args)
+	component_instance add(entity_id e_id, Args&& ... args)
 	{
 		/// Get the available instance in the pool
-		component_instance instance_to_add = m_entities_to_components[e_id];
+		component_instance instance_to_add = look_up(e_id);
 		if (instance_to_add == 0)
 		{
-			instance_to_add = m_component_pool.size;
-			m_entities_to_components[e_id] = instance_to_add;
-			m_component_pool.size++;
-
+			instance_to_add = allocate_instance(e_id);
 		}
 		C component = C(std::forward<Args>(args)...);
 
 		/// Add the component data to the member pools at their new instance
 		reflecs::constexpr_loop::execute<member_count, add_component_data_wrappper>(this, instance_to_add, component);
+		mark_changed(instance_to_add);
+		m_revision++;
 
 		return instance_to_add;
 	}
 
+	/*
+	* @brief Adds the component to many entities, copying every field from its own source column.
+	*		 Entities without the component get back to back instances, so each field is
+	*		 copied with one memcpy per page instead of element by element.
+	*
+	* @tparam ...Fields Field types in declaration order
+	* @param e_ids Entity IDs
+	* @param count Number of entities
+	* @param columns One source array of count elements per field
+	*/
+	template<typename ... Fields>
+	void add_columns(const entity_id* e_ids, size_t count, const Fields* ... columns)
+	{
+		static_assert(sizeof...(Fields) == member_count, "A column is required for every field");
+
+		auto sources = std::make_tuple(columns...);
+		add_batch(e_ids, count, [this, &sources](size_t source, component_instance instance, size_t length)
+			{
+				reflecs::constexpr_loop::execute<member_count, copy_column_wrapper>(this, sources, source, instance, length);
+			}
+		);
+	}
+
+	/*
+	* @brief Adds the component to many entities from an array of constructed components.
+	*		 Entities without the component get back to back instances which are filled field by field.
+	*
+	* @param e_ids Entity IDs
+	* @param count Number of entities
+	* @param components Array of count components
+	*/
+	void add_components(const entity_id* e_ids, size_t count, const C* components)
+	{
+		add_batch(e_ids, count, [this, components](size_t source, component_instance instance, size_t length)
+			{
+				const C* first = components + source;
+				reflecs::constexpr_loop::execute<member_count, gather_field_wrapper>(this, first, instance, length);
+			}
+		);
+	}
+
+	/*
+	* @brief Adds copies of an existing instance to many entities. Entities without the component
+	*		 get back to back instances whose columns are filled with the source's fields,
+	*		 without constructing the component.
+	*
+	* @param e_ids Entity IDs
+	* @param count Number of entities
+	* @param source Instance to copy
+	*/
+	void add_copies(const entity_id* e_ids, size_t count, component_instance source)
+	{
+		add_batch(e_ids, count, [this, source](size_t, component_instance instance, size_t length)
+			{
+				reflecs::constexpr_loop::execute<member_count, fill_field_wrapper>(this, source, instance, length);
+			}
+		);
+	}
+
 	/**
 	 * @brief Maps the entity to the component instance
 	 * @param e_id Entity ID
@@ -97,7 +261,7 @@ public:
 	*/
 	component_instance look_up(entity_id e_id)
 	{
-		return m_entities_to_components[e_id];
+		return m_entities_to_components.get(e_id);
 	}
 
 	/**
@@ -111,7 +275,9 @@ public:
 	}
 
 	/*
-	* @brief Returns the fields buffer
+	* @brief Returns the fields buffer. The instance counts as changed for change tracking and
+	*		 range indices, so handles pair every accessor with a const one built on get_member_value
+	*		 and read-only code takes the handle as const.
 	*
 	* @tparam index Index of the member in the component by order
 	* @param component_instance instance of the component
@@ -119,10 +285,227 @@ public:
 	template<size_t index>
 	auto& get_member_buffer(entity_id component_instance)
 	{
-		using data_type = typename reflecs::component_reflection::get_type<C, index>::type;
+		mark_changed(component_instance);
+		return column_element<index>(component_instance);
+	}
+
+	/*
+	* @brief Reads a field without marking the instance as changed
+	*
+	* @tparam index Index of the member in the component by order
+	* @param instance instance of the component
+	*/
+	template<size_t index>
+	const auto& get_member_value(component_instance instance)
+	{
+		return column_element<index>(instance);
+	}
+
+	/**
+	* @brief Returns the address of the field's instance inside its contiguous column.
+	*		 Consecutive instances of the field follow each other in memory
+	*		 up to the end of the block, see contiguous_instances().
+	*
+	* @tparam index Index of the member in the component by order
+	* @param instance First instance of the component
+	*/
+	template<size_t index>
+	auto* get_member_data(component_instance instance)
+	{
+		return &column_element<index>(instance);
+	}
+
+	/**
+	* @brief Returns a tuple holding the field addresses of every member of the component
+	*
+	* @param instance First instance of the component
+	*/
+	auto get_member_pointers(component_instance instance)
+	{
+		return get_member_pointers(instance, std::make_index_sequence<member_count>());
+	}
+
+	/**
+	* @brief Number of instances stored contiguously starting at the given instance;
+	*		 runs end at the end of the instance's block
+	*
+	* @param instance Instance of the component
+	*/
+	size_t contiguous_instances(component_instance instance) const
+	{
+		return block_width - instance % block_width;
+	}
+
+	/// Number of components stored in the pool
+	size_t size() const
+	{
+		return m_component_pool.size - 1;
+	}
+
+	/// Changes whenever instances are added, overwritten by add, removed, loaded or moved; writes through handles do not count
+	std::uint64_t revision() const
+	{
+		return m_revision;
+	}
+
+	/// Changes the revision without touching the instances, for changes of the owners that orders built from the pool depend on
+	void bump_revision()
+	{
+		m_revision++;
+	}
+
+	/**
+	* @brief Entity slot owning the instance
+	*
+	* @param instance Instance of the component
+	*/
+	size_t owner_of(component_instance instance) const
+	{
+		return m_components_to_entities[instance];
+	}
+
+	/**
+	* @brief Moves the instances so the listed entities own the first instances, in the given order.
+	*		 The remaining instances follow in no particular order. Every move swaps two instances,
+	*		 so the cost is linear in the number of listed entities.
+	*
+	* @param e_slots Slots of distinct entities holding the component
+	*/
+	void sort_instances(const std::vector<size_t>& e_slots)
+	{
+		component_instance target = 1;
+		for (size_t e_slot : e_slots)
+		{
+			component_instance current = look_up(e_slot);
+			assert(current >= target && "Entity is listed twice or does not hold the component");
+			if (current != target)
+			{
+				swap_instances(current, target);
+				m_revision++;
+			}
+			target++;
+		}
+	}
+
+	/// Bytes held by the field pages and both index maps
+	size_t resident_bytes() const
+	{
+		return m_component_pool.pages.size() * m_component_pool.page_bytes
+			+ m_entities_to_components.resident_bytes() + m_components_to_entities.resident_bytes();
+	}
+
+	/**
+	* @brief Stamps the instance with the current tick and marks the range indices stale;
+	*		 does nothing without change tracking or range indices
+	*
+	* @param instance Instance of the component
+	*/
+	void mark_changed(component_instance instance)
+	{
+		if constexpr (tracks_changes)
+		{
+			version_of(instance) = m_tick;
+			m_component_pool.page_versions[instance / g_page_size].store(m_tick, std::memory_order_relaxed);
+		}
+		if constexpr (has_range_index)
+		{
+			reflecs::constexpr_loop::execute<member_count, invalidate_index_wrapper>(this);
+		}
+	}
+
+	/**
+	* @brief Sets the tick stamped on subsequent writes
+	*
+	* @param tick Current tick of the registry
+	*/
+	void set_tick(std::uint32_t tick)
+	{
+		m_tick = tick;
+	}
+
+	/**
+	* @brief Visits the instances written after the given tick. Pages without such
+	*		 instances are skipped as a whole.
+	*
+	* @param since Tick to compare with; instances stamped later are visited
+	* @param function Invoked with the slot index of the entity owning the instance
+	*/
+	template<typename F>
+	void for_each_changed(std::uint32_t since, F&& function)
+	{
+		static_assert(tracks_changes, "Change tracking is not enabled for this component");
+
+		for (size_t page = 0; page < m_component_pool.pages.size(); ++page)
+		{
+			if (m_component_pool.page_versions[page].load(std::memory_order_relaxed) <= since)
+			{
+				continue;
+			}
 
-		std::array<data_type, g_container_size>& arr = *static_cast<std::array<data_type, g_container_size>*>(m_component_pool.buffer[index]);
-		return arr[component_instance];
+			component_instance begin = std::max<size_t>(1, page * g_page_size);
+			component_instance end = std::min(m_component_pool.size, (page + 1) * g_page_size);
+			for (component_instance instance = begin; instance < end; ++instance)
+			{
+				if (version_of(instance) > since)
+				{
+					function(m_components_to_entities[instance]);
+				}
+			}
+		}
+	}
+
+	/**
+	* @brief Visits the entities whose field lies in [lo, hi] in ascending order of the field,
+	*		 using the field's range index; the index is rebuilt first if the pool changed.
+	*		 Must not overlap writes to the pool.
+	*
+	* @tparam index Index of the member in the component by order
+	* @param lo Smallest value to visit
+	* @param hi Largest value to visit
+	* @param function Invoked with the slot index of the entity
+	*/
+	template<size_t index, typename T, typename F>
+	void for_each_in_range(const T& lo, const T& hi, F&& function)
+	{
+		static_assert(reflecs::component_reflection::range_index<C, index>::value, "The field has no range index");
+
+		auto& field = std::get<index>(m_field_indices);
+		rebuild_index<index>(field);
+
+		auto it = std::lower_bound(field.entries.begin(), field.entries.end(), lo, [](const auto& entry, const T& value) { return entry.first < value; });
+		for (; it != field.entries.end() && !(hi < it->first); ++it)
+		{
+			function(it->second);
+		}
+	}
+
+	/// Byte size of a page holding g_page_size instances of every field
+	size_t page_bytes() const
+	{
+		return m_component_pool.page_bytes;
+	}
+
+	/**
+	* @brief Replaces the source of the field pages; the pool must be empty
+	*
+	* @param allocator New page allocator
+	*/
+	void set_allocator(std::unique_ptr<reflecs::storage::page_allocator> allocator)
+	{
+		assert(m_component_pool.size == 1 && "The allocator can only be replaced while the pool is empty");
+
+		m_component_pool.release_pages();
+		m_component_pool.allocator = std::move(allocator);
+	}
+
+	/**
+	* @brief Writes modified pages to the allocator's backing store
+	*
+	* @param wait Block until the data is stored
+	*/
+	bool sync(bool wait)
+	{
+		return m_component_pool.allocator->sync(wait);
 	}
 
 	/**
@@ -133,95 +516,389 @@ public:
 	void remove(entity_id e_id)
 	{
 		/// Find the component instance to remove
-		component_instance instance_to_remove = m_entities_to_components[e_id];
+		component_instance instance_to_remove = look_up(e_id);
 		assert(instance_to_remove > 0 && "Entity is not assigned to this component");
-		assert(instance_to_remove < g_container_size && "instance is out of range");
+		assert(instance_to_remove < m_component_pool.size && "instance is out of range");
 
 		/// If exists, iterate over all members and reassign the last component data to the position of the removing instance  
 		component_instance instance_to_reassign = m_component_pool.size - 1;
 		reflecs::constexpr_loop::execute<member_count, remove_component_data_wrapper>(this, instance_to_remove, instance_to_reassign);
+		if constexpr (tracks_changes)
+		{
+			/// The moved instance keeps its version; its new page must not look older than it
+			std::uint32_t version = version_of(instance_to_reassign);
+			version_of(instance_to_remove) = version;
+			std::atomic<std::uint32_t>& page_version = m_component_pool.page_versions[instance_to_remove / g_page_size];
+			page_version.store(std::max(page_version.load(std::memory_order_relaxed), version), std::memory_order_relaxed);
+		}
+
+		/// Release the entity's slot
+		m_entities_to_components.release(e_id);
 
-		/// Assign the entity's instance to 0
-		m_entities_to_components[e_id] = 0;
+		if (instance_to_remove != instance_to_reassign)
+		{
+			/// Point the entity that owned the last instance to the removed instance
+			entity_id entity_to_reassign = m_components_to_entities[instance_to_reassign];
+			m_entities_to_components[entity_to_reassign] = instance_to_remove;
+			m_components_to_entities[instance_to_remove] = entity_to_reassign;
+		}
+		m_components_to_entities.release(instance_to_reassign);
 
 		/// Decrease the pool size
 		m_component_pool.size--;
+		m_revision++;
+		if constexpr (has_range_index)
+		{
+			reflecs::constexpr_loop::execute<member_count, invalidate_index_wrapper>(this);
+		}
 
-		if (instance_to_remove == instance_to_reassign)
+		/// Give a page back once the pool shrank a whole page below it; the slack avoids thrashing at page borders
+		while (m_component_pool.pages.size() > 1 && m_component_pool.size + g_page_size <= (m_component_pool.pages.size() - 1) * g_page_size)
 		{
-			return;
+			if (m_component_pool.pages.size() > m_component_pool.adopted_pages)
+			{
+				m_component_pool.allocator->release(m_component_pool.pages.back());
+			}
+			else
+			{
+				m_component_pool.adopted_pages--;
+			}
+			m_component_pool.pages.pop_back();
 		}
+	}
+
+	/**
+	* @brief Writes the field pages and both index maps to a snapshot.
+	*		 The field pages form one aligned section so load() can adopt them in place.
+	*
+	* @param out Snapshot writer
+	* @param checkpoint Leave the pages of a persistent allocator in its store and only record their count
+	*/
+	void save(reflecs::snapshot::writer& out, bool checkpoint) const
+	{
+		bool in_store = checkpoint && m_component_pool.allocator->persistent() && m_component_pool.adopted_pages == 0;
+
+		out.write_value(std::uint64_t(member_count));
+		out.write_value(std::uint64_t(block_width));
+		out.write_value(std::uint64_t(sparse));
+		out.write_value(std::uint64_t(m_component_pool.page_bytes));
+		out.write_value(std::uint64_t(m_component_pool.size));
+		out.write_value(std::uint64_t(m_component_pool.pages.size()));
+		out.write_value(std::uint64_t(in_store));
 
-		/// Find the entity ID that has the last component instance assigned to it and change it to the removed instance
-		auto it = std::find_if(m_entities_to_components.begin(), m_entities_to_components.end(), [instance_to_reassign](const auto component_instance)
+		if (!in_store)
+		{
+			out.align();
+			for (void* page : m_component_pool.pages)
 			{
-				return component_instance == instance_to_reassign;
+				out.write(page, m_component_pool.page_bytes);
 			}
-		);
+		}
+
+		m_entities_to_components.save(out);
+		m_components_to_entities.save(out);
+	}
+
+	/**
+	* @brief Restores an empty pool from a snapshot. The field pages are used straight from
+	*		 the mapping instead of being copied; only the index maps are copied. Pages a
+	*		 checkpoint left in the allocator's store are attached from there again.
+	*
+	* @param in Snapshot reader
+	* @return False if the snapshot was written for a different component layout, is truncated,
+	*		  or refers to pages the allocator can not attach
+	*/
+	bool load(reflecs::snapshot::reader& in)
+	{
+		assert(m_component_pool.size == 1 && "Only an empty pool can be loaded");
 
-		if (it != m_entities_to_components.end())
+		std::uint64_t members, width, sparse_index, page_bytes, size, page_count, in_store;
+		if (!in.read_value(members) || !in.read_value(width) || !in.read_value(sparse_index) || !in.read_value(page_bytes) || !in.read_value(size) || !in.read_value(page_count)
+			|| !in.read_value(in_store))
+		{
+			return false;
+		}
+		if (members != member_count || width != block_width || sparse_index != sparse || page_bytes != m_component_pool.page_bytes || page_count > m_component_pool.max_pages
+			|| size == 0 || size > std::max<std::uint64_t>(1, page_count * g_page_size))
 		{
-			*it = instance_to_remove;
+			return false;
 		}
+
+		m_component_pool.release_pages();
+		if (in_store)
+		{
+			if (!m_component_pool.allocator->attach(page_count, m_component_pool.pages))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			char* data = nullptr;
+			if (!in.align() || (page_count > 0 && !(data = in.take(page_count * page_bytes))))
+			{
+				return false;
+			}
+
+			m_component_pool.pages.resize(page_count);
+			for (size_t i = 0; i < page_count; ++i)
+			{
+				m_component_pool.pages[i] = data + i * page_bytes;
+			}
+			m_component_pool.adopted_pages = page_count;
+			m_component_pool.mapping = in.file();
+		}
+		m_component_pool.size = size;
+		m_revision++;
+		if constexpr (has_range_index)
+		{
+			reflecs::constexpr_loop::execute<member_count, invalidate_index_wrapper>(this);
+		}
+		if constexpr (tracks_changes)
+		{
+			/// Stored versions never exceed the saved tick
+			for (size_t i = 0; i < page_count; ++i)
+			{
+				m_component_pool.page_versions[i].store(m_tick, std::memory_order_relaxed);
+			}
+		}
+
+		return m_entities_to_components.load(in) && m_components_to_entities.load(in);
 	}
 
 private:
 
-#pragma region CompileHelpers
 	/**
-	 * @brief Generates field buffers for each member of the component
-	 * @tparam index Index of the component member
-	 * @param buffer Pointer to the buffer
-	 * @param num_elements Size of the buffer
-	 */
+	 * @brief Assigns the next free instance to the entity, allocating a page when needed
+	 * @param e_id Entity ID
+	 * @return Assigned instance
+	*/
+	component_instance allocate_instance(entity_id e_id)
+	{
+		component_instance instance = m_component_pool.size;
+		if (instance / g_page_size == m_component_pool.pages.size())
+		{
+			assert(m_component_pool.pages.size() < m_component_pool.max_pages && "pool is out of capacity");
+			void* page = m_component_pool.allocator->allocate();
+			assert(page && "page allocation failed");
+			m_component_pool.pages.push_back(page);
+			if constexpr (tracks_changes)
+			{
+				m_component_pool.page_versions[m_component_pool.pages.size() - 1].store(0, std::memory_order_relaxed);
+			}
+		}
+
+		m_entities_to_components.acquire(e_id) = instance;
+		m_components_to_entities.acquire(instance) = e_id;
+		m_component_pool.size++;
+		return instance;
+	}
+
+	/**
+	 * @brief Assigns instances for a batch of entities and hands out the copies to perform.
+	 *		  Consecutive entities without the component form a run of consecutive instances
+	 *		  which is passed on in page sized pieces; entities that already have the component
+	 *		  are overwritten one by one.
+	 * @param e_ids Entity IDs
+	 * @param count Number of entities
+	 * @param copy Invoked as copy(first source element, first instance, length)
+	*/
+	template<typename F>
+	void add_batch(const entity_id* e_ids, size_t count, F&& copy)
+	{
+		m_revision++;
+		size_t i = 0;
+		while (i < count)
+		{
+			component_instance existing = look_up(e_ids[i]);
+			if (existing != 0)
+			{
+				copy(i, existing, 1);
+				mark_changed(existing);
+				++i;
+				continue;
+			}
+
+			size_t run_begin = i;
+			component_instance first = m_component_pool.size;
+			while (i < count && look_up(e_ids[i]) == 0)
+			{
+				allocate_instance(e_ids[i]);
+				++i;
+			}
+
+			for (size_t copied = 0; copied < i - run_begin;)
+			{
+				size_t length = std::min(i - run_begin - copied, contiguous_instances(first + copied));
+				copy(run_begin + copied, first + copied, length);
+				for (size_t j = 0; j < length; ++j)
+				{
+					mark_changed(first + copied + j);
+				}
+				copied += length;
+			}
+		}
+	}
+
+	/**
+	 * @brief Exchanges the data, versions and owners of two instances
+	 * @param first Instance of the component
+	 * @param second Instance of the component
+	*/
+	void swap_instances(component_instance first, component_instance second)
+	{
+		reflecs::constexpr_loop::execute<member_count, swap_component_data_wrapper>(this, first, second);
+		if constexpr (tracks_changes)
+		{
+			std::swap(version_of(first), version_of(second));
+
+			/// Each page must not look older than the versions it received
+			for (component_instance instance : { first, second })
+			{
+				std::atomic<std::uint32_t>& page_version = m_component_pool.page_versions[instance / g_page_size];
+				page_version.store(std::max(page_version.load(std::memory_order_relaxed), version_of(instance)), std::memory_order_relaxed);
+			}
+		}
+
+		size_t first_owner = m_components_to_entities[first];
+		size_t second_owner = m_components_to_entities[second];
+		m_components_to_entities[first] = second_owner;
+		m_components_to_entities[second] = first_owner;
+		m_entities_to_components[first_owner] = second;
+		m_entities_to_components[second_owner] = first;
+	}
+
+	/**
+	 * @brief Raw access to a field; does not mark the instance as changed
+	 * @tparam index Index of the member in the component by order
+	 * @param instance Instance of the component
+	*/
 	template<size_t index>
-	void generate_buffers(void* buffer[], size_t num_elements)
+	auto& column_element(component_instance instance)
 	{
 		using data_type = typename reflecs::component_reflection::get_type<C, index>::type;
-		buffer[index + 1] = static_cast<data_type*>(buffer[index]) + num_elements;
 
-		char* previous_address = (char*)buffer[index];
-		char* current_address = (char*)buffer[index + 1];
+		size_t slot = instance % g_page_size;
+		char* block = static_cast<char*>(m_component_pool.pages[instance / g_page_size]) + slot / block_width * m_component_pool.block_bytes;
+		data_type* column = reinterpret_cast<data_type*>(block + m_component_pool.offsets[index]);
+		return column[slot % block_width];
+	}
 
-		size_t byte_count = current_address - previous_address; // debugging
-		assert(byte_count == sizeof(data_type) * g_container_size && "Check member offset");
+	/**
+	 * @brief Version of an instance, stored in the page's version column
+	 * @param instance Instance of the component
+	*/
+	std::uint32_t& version_of(component_instance instance)
+	{
+		char* page = static_cast<char*>(m_component_pool.pages[instance / g_page_size]);
+		return reinterpret_cast<std::uint32_t*>(page + m_component_pool.version_offset)[instance % g_page_size];
 	}
 
 	/**
-	 * @brief Dummy struct to call the generate_buffers function
+	 * @brief Sorts the entities by the field if the index is stale. Values that are not
+	 *		  equal to themselves, i.e. NaN, are left out since they match no range.
+	 * @tparam index Index of the member in the component by order
+	 * @param field Index of the field
+	*/
+	template<size_t index, typename T>
+	void rebuild_index(field_index<T>& field)
+	{
+		if (!field.stale.load(std::memory_order_acquire))
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(field.rebuild_mutex);
+		if (!field.stale.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		field.entries.clear();
+		for (component_instance instance = 1; instance < m_component_pool.size; ++instance)
+		{
+			const T& value = column_element<index>(instance);
+			if (value == value)
+			{
+				field.entries.emplace_back(value, m_components_to_entities[instance]);
+			}
+		}
+		std::sort(field.entries.begin(), field.entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		field.stale.store(false, std::memory_order_release);
+	}
+
+#pragma region CompileHelpers
+	/**
+	 * @brief Marks the field's range index stale, if it has one
+	 * @tparam index Index of the component member
+	 */
+	template<size_t index>
+	void invalidate_index()
+	{
+		if constexpr (reflecs::component_reflection::range_index<C, index>::value)
+		{
+			/// Read first so concurrent writers do not keep bouncing the cache line
+			std::atomic<bool>& stale = std::get<index>(m_field_indices).stale;
+			if (!stale.load(std::memory_order_relaxed))
+			{
+				stale.store(true, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * @brief Dummy struct to call the invalidate_index function
 	 * @tparam index Member index in the component
-	 *
 	*/
 	template<size_t index>
-	struct generate_buffers_wrapper
+	struct invalidate_index_wrapper
 	{
-		void operator()(component_manager<C>* manager, void* buffer[], size_t num_elements)
+		void operator()(component_manager<C>* manager)
 		{
-			manager->generate_buffers<index>(buffer, num_elements);
+			manager->invalidate_index<index>();
 		}
 	};
 
 	/**
-	 * @brief Counts the byte size of the component
-	 * @tparam index member index in the component
-	 * @param bytes Total byte size of the component
-	*/
+	 * @brief Expands the member indices into a tuple of field addresses
+	 * @tparam ...indices Indices of the component members
+	 * @param instance First instance of the component
+	 */
+	template<size_t ... indices>
+	auto get_member_pointers(component_instance instance, std::index_sequence<indices...>)
+	{
+		return std::make_tuple(get_member_data<indices>(instance)...);
+	}
+
+	/**
+	 * @brief Places the field's column inside a block right after the previous column
+	 * @tparam index Index of the component member
+	 * @param block_bytes Byte size of the block so far
+	 * @param block_alignment Largest field alignment so far
+	 */
 	template<size_t index>
-	void count_component_size(size_t& bytes)
+	void generate_offsets(size_t& block_bytes, size_t& block_alignment)
 	{
-		bytes += sizeof(typename reflecs::component_reflection::get_type<C, index>::type);
+		using data_type = typename reflecs::component_reflection::get_type<C, index>::type;
+
+		/// Keep the column aligned for its type
+		block_bytes = (block_bytes + alignof(data_type) - 1) / alignof(data_type) * alignof(data_type);
+		m_component_pool.offsets[index] = block_bytes;
+		block_bytes += sizeof(data_type) * block_width;
+		block_alignment = std::max(block_alignment, alignof(data_type));
 	}
 
 	/**
-	* @brief Dummy struct to call the count_component_size function
-	* @tparam index Member index in the component
+	 * @brief Dummy struct to call the generate_offsets function
+	 * @tparam index Member index in the component
+	 *
 	*/
 	template<size_t index>
-	struct count_component_size_wrapper
+	struct generate_offsets_wrapper
 	{
-		void operator()(component_manager<C>* manager, size_t& bytes)
+		void operator()(component_manager<C>* manager, size_t& block_bytes, size_t& block_alignment)
 		{
-			manager->count_component_size<index>(bytes);
+			manager->generate_offsets<index>(block_bytes, block_alignment);
 		}
 	};
 
@@ -246,14 +923,98 @@ private:
 	*/
 	template<size_t index>
 	void add_component_data(component_instance instance_to_add, C& component)
+	{
+		column_element<index>(instance_to_add) = component.*reflecs::component_reflection::get_pointer_to_member<C, index>();
+	}
+
+	/**
+	 * @brief Copies a piece of a source column into the field's column
+	 * @tparam index Index of the member in the component
+	 * @param sources Tuple of source columns
+	 * @param source First source element
+	 * @param instance First instance to write
+	 * @param length Number of elements; the instances must not cross a page
+	*/
+	template<size_t index, typename Sources>
+	void copy_column(Sources& sources, size_t source, component_instance instance, size_t length)
 	{
 		using data_type = typename reflecs::component_reflection::get_type<C, index>::type;
+		static_assert(std::is_same<std::tuple_element_t<index, Sources>, const data_type*>::value, "Column type does not match the field type");
+
+		std::memcpy(&column_element<index>(instance), std::get<index>(sources) + source, length * sizeof(data_type));
+	}
 
-		std::array<data_type, g_container_size>& array_handle = *static_cast<std::array<data_type, g_container_size>*>(m_component_pool.buffer[index]);
+	/**
+	 * @brief Dummy struct to call the copy_column function
+	 * @tparam index Member index in the component
+	*/
+	template<size_t index>
+	struct copy_column_wrapper
+	{
+		template<typename Sources>
+		void operator()(component_manager<C>* mgr, Sources& sources, size_t source, component_instance instance, size_t length)
+		{
+			mgr->copy_column<index>(sources, source, instance, length);
+		}
+	};
 
-		array_handle[instance_to_add] = component.*reflecs::component_reflection::get_pointer_to_member<C, index>();
+	/**
+	 * @brief Gathers the field of consecutive components into the field's column
+	 * @tparam index Index of the member in the component
+	 * @param components First component to read
+	 * @param instance First instance to write
+	 * @param length Number of elements; the instances must not cross a page
+	*/
+	template<size_t index>
+	void gather_field(const C* components, component_instance instance, size_t length)
+	{
+		auto* column = &column_element<index>(instance);
+		for (size_t i = 0; i < length; ++i)
+		{
+			column[i] = components[i].*reflecs::component_reflection::get_pointer_to_member<C, index>();
+		}
 	}
 
+	/**
+	 * @brief Dummy struct to call the gather_field function
+	 * @tparam index Member index in the component
+	*/
+	template<size_t index>
+	struct gather_field_wrapper
+	{
+		void operator()(component_manager<C>* mgr, const C* components, component_instance instance, size_t length)
+		{
+			mgr->gather_field<index>(components, instance, length);
+		}
+	};
+
+	/**
+	 * @brief Broadcasts the field of one instance into the field's column
+	 * @tparam index Index of the member in the component
+	 * @param source Instance to copy
+	 * @param instance First instance to write
+	 * @param length Number of elements; the instances must not cross a block
+	*/
+	template<size_t index>
+	void fill_field(component_instance source, component_instance instance, size_t length)
+	{
+		auto value = column_element<index>(source);
+		std::fill_n(&column_element<index>(instance), length, value);
+	}
+
+	/**
+	 * @brief Dummy struct to call the fill_field function
+	 * @tparam index Member index in the component
+	*/
+	template<size_t index>
+	struct fill_field_wrapper
+	{
+		void operator()(component_manager<C>* mgr, component_instance source, component_instance instance, size_t length)
+		{
+			mgr->fill_field<index>(source, instance, length);
+		}
+	};
+
 	/**
 	 * @brief Dummy struct to call the removeComponentData function
 	 * @tparam index Member index in the component
@@ -275,12 +1036,94 @@ private:
 	template<size_t index>
 	void remove_component_data(component_instance instance_to_remove, component_instance replacing_instance)
 	{
-		using data_type = typename reflecs::component_reflection::get_type<C, index>::type;
-		std::array<data_type, g_container_size>& array_handle = *static_cast<std::array<data_type, g_container_size>*>(m_component_pool.buffer[index]);
+		column_element<index>(instance_to_remove) = column_element<index>(replacing_instance);
+	}
 
-		array_handle[instance_to_remove] = array_handle[replacing_instance];
+	/**
+	 * @brief Dummy struct to call the swap_component_data function
+	 * @tparam index Member index in the component
+	*/
+	template<size_t index>
+	struct swap_component_data_wrapper
+	{
+		void operator()(component_manager<C>* mgr, component_instance first, component_instance second)
+		{
+			mgr->swap_component_data<index>(first, second);
+		}
+	};
+
+	/**
+	 * @brief Exchanges the field of two instances
+	 * @tparam index Index of the member in the component
+	 * @param first Instance of the component
+	 * @param second Instance of the component
+	*/
+	template<size_t index>
+	void swap_component_data(component_instance first, component_instance second)
+	{
+		std::swap(column_element<index>(first), column_element<index>(second));
 	}
 #pragma endregion
 
 };
 
+
+/**
+ * @class tag_manager
+ *
+ * @brief Stands in for the component_manager of a tag. Tags carry no data and only
+ *		  exist as a bit in the registry's signatures, so nothing is allocated and
+ *		  adding or removing a tag only moves the entity to another bucket.
+ *
+ * @tparam C Tag type
+ */
+template<typename C>
+class tag_manager
+{
+public:
+	static_assert(!reflecs::component_reflection::track_changes<C>::value, "Tags can not track changes");
+
+	explicit tag_manager(size_t = g_max_entities)
+	{
+	}
+
+	/// Tags have no instances
+	component_instance look_up(entity_id) const
+	{
+		return 0;
+	}
+
+	/// A tag never ends a contiguous run
+	size_t contiguous_instances(component_instance) const
+	{
+		return g_page_size;
+	}
+
+	/// Tags have no fields
+	std::tuple<> get_member_pointers(component_instance) const
+	{
+		return {};
+	}
+
+	void set_tick(std::uint32_t)
+	{
+	}
+
+	bool sync(bool)
+	{
+		return true;
+	}
+
+	void save(reflecs::snapshot::writer&, bool) const
+	{
+	}
+
+	bool load(reflecs::snapshot::reader&)
+	{
+		return true;
+	}
+};
+
+/// Storage of a component inside the registry
+template<typename C>
+using component_storage = std::conditional_t<reflecs::component_reflection::is_tag<C>::value, tag_manager<C>, component_manager<C>>;
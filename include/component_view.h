@@ -0,0 +1,85 @@
+#pragma once
+#include "component_manager.h"
+
+/// Marks pointers that do not alias any other pointer in scope; only honored on function parameters
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define REFLECS_RESTRICT __restrict
+#else
+#define REFLECS_RESTRICT
+#endif
+
+
+/**
+ * @class component_view
+ *
+ * @brief Handle generated from the reflection traits; no specialization is needed.
+ *		  The field base pointers are resolved once per block of contiguous instances
+ *		  and shared by every row of the block, so accessing a field is a single indexed
+ *		  load or store. The columns of a page never overlap, so the registry passes the
+ *		  pointers of a block into its row loop as restrict parameters and the compiler
+ *		  vectorizes writes without runtime alias checks.
+ *		  A view of a const component only hands out const references; a view of a tag has no fields.
+ *
+ * @tparam C Component type, optionally const
+ */
+template<typename C>
+class component_view
+{
+private:
+	using component = std::remove_const_t<C>;
+	static constexpr size_t member_count = reflecs::component_reflection::get_member_count<component>::count;
+
+	template<size_t index>
+	using field_type = std::conditional_t<std::is_const<C>::value,
+		const typename reflecs::component_reflection::get_type<component, index>::type,
+		typename reflecs::component_reflection::get_type<component, index>::type>;
+
+	template<typename Indices>
+	struct block_of;
+
+	template<size_t ... indices>
+	struct block_of<std::index_sequence<indices...>>
+	{
+		using type = std::tuple<field_type<indices>*...>;
+	};
+
+public:
+	/// Field base pointers of a block of contiguous instances
+	using block = typename block_of<std::make_index_sequence<member_count>>::type;
+
+private:
+	const block& m_fields;
+	size_t m_row; // Offset of the instance inside the block
+
+public:
+
+	/**
+	 * @param fields Field base pointers of the block
+	 * @param row Offset of the instance inside the block
+	*/
+	component_view(const block& fields, size_t row)
+		: m_fields(fields)
+		, m_row(row)
+	{
+	}
+
+	/**
+	 * @brief Resolves the field base pointers of a block
+	 * @param pool Component pool
+	 * @param first First instance of the block
+	*/
+	static block resolve(component_storage<component>& pool, component_instance first)
+	{
+		return pool.get_member_pointers(first);
+	}
+
+	/**
+	 * @brief Accesses a field
+	 * @tparam index Index of the member in the component by order
+	*/
+	template<size_t index>
+	field_type<index>& get() const
+	{
+		return std::get<index>(m_fields)[m_row];
+	}
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include "common.h"
+#include <mutex>
+#include <shared_mutex>
+
+/// Define REFLECS_CONCURRENT_MUTATION=1 to let several threads add, remove and destroy at once.
+/// When it is 0 (the default) every lock compiles away.
+#ifndef REFLECS_CONCURRENT_MUTATION
+#define REFLECS_CONCURRENT_MUTATION 0
+#endif
+
+namespace reflecs
+{
+	namespace concurrency
+	{
+		constexpr bool enabled = REFLECS_CONCURRENT_MUTATION != 0;
+
+		constexpr size_t g_lock_stripes = enabled ? 256 : 1; // Number of locks shared by the entities, and by the buckets
+
+		/// std::mutex that only locks with concurrent mutation enabled
+		class mutex
+		{
+		private:
+			std::mutex m_mutex;
+
+		public:
+			void lock()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.lock();
+				}
+			}
+
+			void unlock()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.unlock();
+				}
+			}
+		};
+
+		/// std::shared_mutex that only locks with concurrent mutation enabled
+		class shared_mutex
+		{
+		private:
+			std::shared_mutex m_mutex;
+
+		public:
+			void lock()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.lock();
+				}
+			}
+
+			void unlock()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.unlock();
+				}
+			}
+
+			void lock_shared()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.lock_shared();
+				}
+			}
+
+			void unlock_shared()
+			{
+				if constexpr (enabled)
+				{
+					m_mutex.unlock_shared();
+				}
+			}
+		};
+	}
+}
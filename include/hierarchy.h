@@ -0,0 +1,50 @@
+#pragma once
+#include "component_manager.h"
+
+
+/**
+ * @struct parent_link
+ *
+ * @brief Built-in relationship component attaching an entity to its parent, e.g. a weapon to
+ *		  the character holding it. Register it with the registry like any other component and
+ *		  change it with add and remove; the registry then orders pools by hierarchy depth
+ *		  for registry::for_each_in_depth_order.
+ */
+struct parent_link
+{
+	parent_link() = default;
+
+	explicit parent_link(entity_id parent_id)
+		: parent(parent_id)
+	{}
+
+	entity_id parent = g_invalid_entity;
+};
+
+template<> struct reflecs::component_reflection::get_member_count<parent_link>
+{
+	static const int count = 1;
+};
+
+template<> struct reflecs::component_reflection::get_type<parent_link, 0>
+{
+	using type = entity_id;
+};
+
+template<> inline typename reflecs::component_reflection::get_pointer_to_member_type<parent_link, 0>::type reflecs::component_reflection::get_pointer_to_member<parent_link, 0>() { return &parent_link::parent; }
+
+/// Read-only; links are changed through the registry so it notices when the hierarchy has to be sorted again
+template<>
+class component_handle<parent_link>
+{
+public:
+	component_manager<parent_link>& pool;
+	component_instance instance;
+
+	component_handle(component_manager<parent_link>& link_pool, component_instance instance)
+		: pool(link_pool)
+		, instance(instance)
+	{}
+
+	inline entity_id parent() const { return pool.get_member_value<0>(instance); }
+};
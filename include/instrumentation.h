@@ -0,0 +1,288 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// Define REFLECS_INSTRUMENTATION=1 to collect hot-path counters and query timings.
+/// When it is 0 (the default) every hook compiles away.
+#ifndef REFLECS_INSTRUMENTATION
+#define REFLECS_INSTRUMENTATION 0
+#endif
+
+namespace reflecs
+{
+	namespace instrumentation
+	{
+		constexpr bool enabled = REFLECS_INSTRUMENTATION != 0;
+
+		constexpr size_t g_max_queries = 64; // Number of distinct queries that are timed separately
+
+		/// Occupancy and traffic of a component pool
+		struct pool_stats
+		{
+			size_t instances = 0; // Components stored in the pool
+			size_t resident_bytes = 0; // Bytes of the allocated dense and sparse pages
+			std::uint64_t adds = 0;
+			std::uint64_t removes = 0;
+		};
+
+		/// Time spent in a query, identified by the signature it matches
+		struct query_stats
+		{
+			std::string signature; // One character per registered component, last component first; excluded and any_of masks follow
+			std::uint64_t calls = 0;
+			std::uint64_t entities = 0; // Entities visited
+			std::uint64_t nanoseconds = 0;
+		};
+
+		/// Snapshot of a registry; counters cover the time since the last reset_stats()
+		struct registry_stats
+		{
+			size_t entities = 0; // Entities stored in signature buckets
+			size_t buckets = 0; // Signature buckets, including empty ones
+			size_t empty_buckets = 0;
+			std::vector<size_t> bucket_histogram; // Entry i counts the non-empty buckets holding [2^i, 2^(i+1)) entities
+			std::vector<pool_stats> pools; // In registration order
+			std::vector<query_stats> queries; // Only with instrumentation enabled
+			std::uint64_t created = 0;
+			std::uint64_t destroyed = 0;
+			std::uint64_t migrations = 0; // Bucket changes of single entities
+
+			/// Prints a compact human readable summary
+			void print(std::ostream& out) const
+			{
+				out << "entities " << entities << ", buckets " << buckets << " (" << empty_buckets << " empty)"
+					<< ", created " << created << ", destroyed " << destroyed << ", migrations " << migrations << "\n";
+
+				out << "bucket sizes:";
+				for (size_t i = 0; i < bucket_histogram.size(); ++i)
+				{
+					if (bucket_histogram[i] > 0)
+					{
+						out << " [" << (size_t(1) << i) << "+]=" << bucket_histogram[i];
+					}
+				}
+				out << "\n";
+
+				for (size_t i = 0; i < pools.size(); ++i)
+				{
+					out << "pool " << i << ": " << pools[i].instances << " instances, " << pools[i].resident_bytes << " bytes"
+						<< ", adds " << pools[i].adds << ", removes " << pools[i].removes << "\n";
+				}
+				for (const query_stats& query : queries)
+				{
+					out << "query " << query.signature << ": " << query.calls << " calls, " << query.entities << " entities, "
+						<< query.nanoseconds / 1000 << " us\n";
+				}
+			}
+		};
+
+		/**
+		 * @brief Counter written by a single thread and read by any. Updates are a relaxed
+		 *		  load and store, so the hot path never executes a locked instruction.
+		 */
+		class counter
+		{
+		private:
+			std::atomic<std::uint64_t> m_value = 0;
+
+		public:
+			void add(std::uint64_t n)
+			{
+				m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+			}
+
+			std::uint64_t load() const
+			{
+				return m_value.load(std::memory_order_relaxed);
+			}
+		};
+
+		/// Counters of a single thread
+		template<size_t components>
+		struct thread_counters
+		{
+			std::array<counter, components> adds;
+			std::array<counter, components> removes;
+			counter created;
+			counter destroyed;
+			counter migrations;
+			std::array<counter, g_max_queries> query_calls;
+			std::array<counter, g_max_queries> query_entities;
+			std::array<counter, g_max_queries> query_nanoseconds;
+		};
+
+		/// Sum of the counters of every thread
+		template<size_t components>
+		struct counter_totals
+		{
+			std::array<std::uint64_t, components> adds = {};
+			std::array<std::uint64_t, components> removes = {};
+			std::uint64_t created = 0;
+			std::uint64_t destroyed = 0;
+			std::uint64_t migrations = 0;
+			std::array<std::uint64_t, g_max_queries> query_calls = {};
+			std::array<std::uint64_t, g_max_queries> query_entities = {};
+			std::array<std::uint64_t, g_max_queries> query_nanoseconds = {};
+		};
+
+		/**
+		 * @class collector
+		 *
+		 * @brief Owns the per-thread counters of a registry. Each thread registers its block once
+		 *		  and then updates it without synchronization; snapshots sum all blocks.
+		 *
+		 * @tparam components Number of registered components
+		 */
+		template<size_t components>
+		class collector
+		{
+		private:
+			size_t m_uid = next_uid(); // Identifies the collector in the per-thread lookup
+			std::vector<std::unique_ptr<thread_counters<components>>> m_threads;
+			std::mutex m_threads_mutex; // Guards m_threads while a thread registers its block
+			counter_totals<components> m_baseline; // Totals at the last reset
+
+		public:
+
+			/// Returns the calling thread's counters
+			thread_counters<components>& local()
+			{
+				static thread_local std::vector<std::pair<size_t, thread_counters<components>*>> t_counters; // Blocks of this thread, keyed by collector uid
+
+				for (auto& [uid, counters] : t_counters)
+				{
+					if (uid == m_uid)
+					{
+						return *counters;
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(m_threads_mutex);
+				m_threads.push_back(std::make_unique<thread_counters<components>>());
+				t_counters.emplace_back(m_uid, m_threads.back().get());
+				return *m_threads.back();
+			}
+
+			/// Counters accumulated since the last reset
+			counter_totals<components> totals()
+			{
+				counter_totals<components> sum = raw_totals();
+				for (size_t i = 0; i < components; ++i)
+				{
+					sum.adds[i] -= m_baseline.adds[i];
+					sum.removes[i] -= m_baseline.removes[i];
+				}
+				sum.created -= m_baseline.created;
+				sum.destroyed -= m_baseline.destroyed;
+				sum.migrations -= m_baseline.migrations;
+				for (size_t i = 0; i < g_max_queries; ++i)
+				{
+					sum.query_calls[i] -= m_baseline.query_calls[i];
+					sum.query_entities[i] -= m_baseline.query_entities[i];
+					sum.query_nanoseconds[i] -= m_baseline.query_nanoseconds[i];
+				}
+				return sum;
+			}
+
+			/// Starts a new measuring period; the thread blocks are left untouched
+			void reset()
+			{
+				m_baseline = raw_totals();
+			}
+
+		private:
+			static size_t next_uid()
+			{
+				static std::atomic<size_t> uid = 0;
+				return uid.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			counter_totals<components> raw_totals()
+			{
+				counter_totals<components> sum;
+
+				std::lock_guard<std::mutex> lock(m_threads_mutex);
+				for (auto& counters : m_threads)
+				{
+					for (size_t i = 0; i < components; ++i)
+					{
+						sum.adds[i] += counters->adds[i].load();
+						sum.removes[i] += counters->removes[i].load();
+					}
+					sum.created += counters->created.load();
+					sum.destroyed += counters->destroyed.load();
+					sum.migrations += counters->migrations.load();
+					for (size_t i = 0; i < g_max_queries; ++i)
+					{
+						sum.query_calls[i] += counters->query_calls[i].load();
+						sum.query_entities[i] += counters->query_entities[i].load();
+						sum.query_nanoseconds[i] += counters->query_nanoseconds[i].load();
+					}
+				}
+				return sum;
+			}
+		};
+
+		/**
+		 * @class query_timer
+		 *
+		 * @brief Times a query from construction to destruction and counts the visited entities.
+		 *		  Does nothing when instrumentation is disabled.
+		 *
+		 * @tparam components Number of registered components
+		 */
+		template<size_t components>
+		class query_timer
+		{
+		private:
+			collector<components>* m_stats = nullptr;
+			size_t m_slot = 0;
+			size_t m_entities = 0;
+			std::chrono::steady_clock::time_point m_start;
+
+		public:
+			query_timer(collector<components>& stats, size_t slot)
+			{
+				if constexpr (enabled)
+				{
+					m_stats = &stats;
+					m_slot = slot;
+					m_start = std::chrono::steady_clock::now();
+				}
+			}
+
+			query_timer(const query_timer&) = delete;
+			query_timer& operator=(const query_timer&) = delete;
+
+			/// Adds visited entities
+			void count(size_t entities)
+			{
+				if constexpr (enabled)
+				{
+					m_entities += entities;
+				}
+			}
+
+			~query_timer()
+			{
+				if constexpr (enabled)
+				{
+					if (m_slot >= g_max_queries)
+					{
+						return;
+					}
+
+					auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+					thread_counters<components>& counters = m_stats->local();
+					counters.query_calls[m_slot].add(1);
+					counters.query_entities[m_slot].add(m_entities);
+					counters.query_nanoseconds[m_slot].add(elapsed);
+				}
+			}
+		};
+	}
+}
@@ -0,0 +1,284 @@
+#pragma once
+#include "common.h"
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define REFLECS_HAS_MMAP 1
+#else
+#define REFLECS_HAS_MMAP 0
+#endif
+
+namespace reflecs
+{
+	namespace storage
+	{
+		/**
+		 * @class page_allocator
+		 *
+		 * @brief Source of the field pages of a component pool. Pages are released
+		 *		  in the reverse order of their allocation.
+		 */
+		class page_allocator
+		{
+		public:
+			virtual ~page_allocator() = default;
+
+			/**
+			 * @brief Provides the memory of a page
+			 * @return The page or nullptr if no memory is left
+			 */
+			virtual void* allocate() = 0;
+
+			/**
+			 * @brief Gives back the most recently allocated page
+			 * @param data Memory returned by allocate()
+			 */
+			virtual void release(void* data) = 0;
+
+			/**
+			 * @brief Writes modified pages to their backing store, if there is one
+			 * @param wait Block until the data reached the store instead of only scheduling it
+			 * @return Whether the write succeeded or was scheduled
+			 */
+			virtual bool sync(bool wait) = 0;
+
+			/**
+			 * @brief Gives back the most recently allocated page while the pool is torn down;
+			 *		  persistent stores keep its contents for a later attach()
+			 * @param data Memory returned by allocate()
+			 */
+			virtual void detach(void* data)
+			{
+				release(data);
+			}
+
+			/// Whether the pages outlive the allocator, so a checkpoint may refer to them instead of copying them
+			virtual bool persistent() const
+			{
+				return false;
+			}
+
+			/**
+			 * @brief Takes over the leading pages the backing store already holds, e.g. after a restart.
+			 *		  Only valid before the first allocation; the pages are then released like allocated ones.
+			 * @param count Number of pages to take over
+			 * @param pages Receives the pages in order
+			 * @return False if the store holds fewer pages or can not be reattached
+			 */
+			virtual bool attach(size_t count, std::vector<void*>& pages)
+			{
+				(void)count;
+				(void)pages;
+				return false;
+			}
+		};
+
+		/// Default allocator; pages come from malloc
+		class heap_page_allocator : public page_allocator
+		{
+		private:
+			size_t m_page_bytes;
+
+		public:
+			explicit heap_page_allocator(size_t page_bytes)
+				: m_page_bytes(page_bytes)
+			{
+			}
+
+			void* allocate() override
+			{
+				return malloc(m_page_bytes);
+			}
+
+			void release(void* data) override
+			{
+				free(data);
+			}
+
+			bool sync(bool) override
+			{
+				return true;
+			}
+		};
+
+#if REFLECS_HAS_MMAP
+		/**
+		 * @class file_page_allocator
+		 *
+		 * @brief Backs pages with a shared mapping of a file, the i-th page at byte offset i * page_bytes.
+		 *		  The kernel writes cold pages back to the file instead of swap, so a pool may exceed
+		 *		  physical memory, and sync() flushes the pages to disk. Once in use, the file spans
+		 *		  exactly the allocated pages; disk space is reserved when a page is allocated, so a
+		 *		  full disk fails the allocation instead of faulting on first write.
+		 *
+		 *		  The file holds page contents only. Opening keeps an existing file, so after a restart
+		 *		  attach() maps its pages again, while the first allocate() on a fresh pool discards
+		 *		  them. The pool's size and index maps are stored by registry::checkpoint.
+		 */
+		class file_page_allocator : public page_allocator
+		{
+		private:
+			int m_descriptor;
+			size_t m_page_bytes;
+			std::vector<void*> m_pages; // Mapped pages in pool order
+
+			file_page_allocator(int descriptor, size_t page_bytes)
+				: m_descriptor(descriptor)
+				, m_page_bytes(page_bytes)
+			{
+			}
+
+			/// Unmaps every page without touching the file
+			void unmap_pages()
+			{
+				for (void* page : m_pages)
+				{
+					munmap(page, m_page_bytes);
+				}
+				m_pages.clear();
+			}
+
+		public:
+			~file_page_allocator() override
+			{
+				unmap_pages();
+				::close(m_descriptor);
+			}
+
+			file_page_allocator(const file_page_allocator&) = delete;
+			file_page_allocator& operator=(const file_page_allocator&) = delete;
+
+			/**
+			 * @brief Opens or creates the backing file; existing contents are kept until attach()
+			 *		  takes them over or the first allocate() discards them
+			 * @param path File path
+			 * @param page_bytes Byte size of a page; must be a multiple of the system page size
+			 * @return The allocator or nullptr if the file can not be opened
+			 */
+			static std::unique_ptr<file_page_allocator> open(const char* path, size_t page_bytes)
+			{
+				if (page_bytes % static_cast<size_t>(sysconf(_SC_PAGESIZE)) != 0)
+				{
+					return nullptr;
+				}
+
+				int descriptor = ::open(path, O_RDWR | O_CREAT, 0644);
+				if (descriptor < 0)
+				{
+					return nullptr;
+				}
+				return std::unique_ptr<file_page_allocator>(new file_page_allocator(descriptor, page_bytes));
+			}
+
+			void* allocate() override
+			{
+				/// A fresh pool starts a new file instead of reusing the pages of an earlier run
+				if (m_pages.empty() && ftruncate(m_descriptor, 0) != 0)
+				{
+					return nullptr;
+				}
+
+				off_t offset = static_cast<off_t>(m_pages.size() * m_page_bytes);
+#if defined(__linux__)
+				if (posix_fallocate(m_descriptor, offset, static_cast<off_t>(m_page_bytes)) != 0)
+				{
+					return nullptr;
+				}
+#else
+				if (ftruncate(m_descriptor, offset + static_cast<off_t>(m_page_bytes)) != 0)
+				{
+					return nullptr;
+				}
+#endif
+
+				void* data = mmap(nullptr, m_page_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_descriptor, offset);
+				if (data == MAP_FAILED)
+				{
+					ftruncate(m_descriptor, offset);
+					return nullptr;
+				}
+
+				m_pages.push_back(data);
+				return data;
+			}
+
+			void release(void* data) override
+			{
+				assert(!m_pages.empty() && data == m_pages.back() && "only the last page can be released");
+
+				munmap(data, m_page_bytes);
+				m_pages.pop_back();
+				ftruncate(m_descriptor, static_cast<off_t>(m_pages.size() * m_page_bytes));
+			}
+
+			bool sync(bool wait) override
+			{
+				bool synced = true;
+				for (void* page : m_pages)
+				{
+					synced = msync(page, m_page_bytes, wait ? MS_SYNC : MS_ASYNC) == 0 && synced;
+				}
+				if (wait)
+				{
+					synced = fsync(m_descriptor) == 0 && synced;
+				}
+				return synced;
+			}
+
+			void detach(void* data) override
+			{
+				assert(!m_pages.empty() && data == m_pages.back() && "only the last page can be detached");
+
+				munmap(data, m_page_bytes);
+				m_pages.pop_back();
+			}
+
+			bool persistent() const override
+			{
+				return true;
+			}
+
+			bool attach(size_t count, std::vector<void*>& pages) override
+			{
+				assert(m_pages.empty() && "Pages can only be attached before the first allocation");
+
+				struct stat info;
+				if (fstat(m_descriptor, &info) != 0 || static_cast<size_t>(info.st_size) < count * m_page_bytes)
+				{
+					return false;
+				}
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					void* data = mmap(nullptr, m_page_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_descriptor, static_cast<off_t>(i * m_page_bytes));
+					if (data == MAP_FAILED)
+					{
+						unmap_pages();
+						return false;
+					}
+					m_pages.push_back(data);
+				}
+
+				/// Pages the pool grew after the checkpoint are not part of it
+				if (ftruncate(m_descriptor, static_cast<off_t>(count * m_page_bytes)) != 0)
+				{
+					unmap_pages();
+					return false;
+				}
+				pages = m_pages;
+				return true;
+			}
+
+			/// Current size of the backing file in bytes
+			size_t file_bytes() const
+			{
+				return m_pages.size() * m_page_bytes;
+			}
+		};
+#endif
+	}
+}
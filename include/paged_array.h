@@ -0,0 +1,233 @@
+#pragma once
+#include "common.h"
+#include "snapshot.h"
+#include <atomic>
+#include <memory>
+
+
+/**
+ * @class paged_array
+ *
+ * @brief Fixed-capacity array whose storage is split into pages of g_page_size elements.
+ *		  Pages are allocated the first time one of their slots is acquired and freed
+ *		  once the last acquired slot is released, so memory follows the used range
+ *		  instead of the capacity.
+ *
+ *		  ensure() and get() may be called from several threads at once; a page that is
+ *		  allocated concurrently is published with a compare-exchange. acquire() and release()
+ *		  keep per-page usage counts and are not thread-safe.
+ *
+ * @tparam T Element type
+ */
+template<typename T>
+class paged_array
+{
+private:
+	size_t m_page_count; // Number of entries in the page directory
+	std::unique_ptr<std::atomic<T*>[]> m_pages; // Page directory; null for pages that are not allocated
+	std::vector<size_t> m_page_usage; // Number of acquired slots per page
+
+public:
+
+	/**
+	 * @brief Creates an empty array
+	 * @param capacity Maximum number of elements
+	*/
+	explicit paged_array(size_t capacity = 0)
+		: m_page_count((capacity + g_page_size - 1) / g_page_size)
+		, m_pages(std::make_unique<std::atomic<T*>[]>(m_page_count))
+		, m_page_usage(m_page_count)
+	{
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			m_pages[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	~paged_array()
+	{
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			delete[] m_pages[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	paged_array(const paged_array&) = delete;
+	paged_array& operator=(const paged_array&) = delete;
+
+	/// Maximum number of elements
+	size_t capacity() const
+	{
+		return m_page_count * g_page_size;
+	}
+
+	/// Bytes held by the allocated pages
+	size_t resident_bytes() const
+	{
+		size_t pages = 0;
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			pages += m_pages[i].load(std::memory_order_relaxed) != nullptr;
+		}
+		return pages * g_page_size * sizeof(T);
+	}
+
+	/**
+	 * @brief Writes the allocated pages together with their usage counts
+	 * @param out Snapshot writer
+	*/
+	void save(reflecs::snapshot::writer& out) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only arrays of trivially copyable elements can be saved");
+
+		std::uint64_t allocated = 0;
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			allocated += m_pages[i].load(std::memory_order_relaxed) != nullptr;
+		}
+		out.write_value(allocated);
+
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			if (m_pages[i].load(std::memory_order_relaxed))
+			{
+				out.write_value(std::uint64_t(i));
+				out.write_value(std::uint64_t(m_page_usage[i]));
+			}
+		}
+		for (size_t i = 0; i < m_page_count; ++i)
+		{
+			if (const T* page = m_pages[i].load(std::memory_order_relaxed))
+			{
+				out.write(page, g_page_size * sizeof(T));
+			}
+		}
+	}
+
+	/**
+	 * @brief Restores the pages written by save(); the array must not have pages yet
+	 * @param in Snapshot reader
+	 * @return False if the snapshot does not fit the array
+	*/
+	bool load(reflecs::snapshot::reader& in)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only arrays of trivially copyable elements can be loaded");
+
+		std::uint64_t allocated;
+		if (!in.read_value(allocated) || allocated > m_page_count)
+		{
+			return false;
+		}
+
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> directory(allocated); // Page index and usage count
+		for (auto& [page, usage] : directory)
+		{
+			if (!in.read_value(page) || !in.read_value(usage) || page >= m_page_count)
+			{
+				return false;
+			}
+		}
+		for (auto& [page, usage] : directory)
+		{
+			if (!in.read(&ensure(page * g_page_size), g_page_size * sizeof(T)))
+			{
+				return false;
+			}
+			m_page_usage[page] = usage;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Accesses an element whose page is known to be allocated
+	 * @param index Element index
+	*/
+	T& operator[](size_t index)
+	{
+		return m_pages[index / g_page_size].load(std::memory_order_acquire)[index % g_page_size];
+	}
+
+	const T& operator[](size_t index) const
+	{
+		return m_pages[index / g_page_size].load(std::memory_order_acquire)[index % g_page_size];
+	}
+
+	/**
+	 * @brief Returns the element's address or nullptr if its page does not exist
+	 * @param index Element index
+	*/
+	T* find(size_t index) const
+	{
+		if (index >= capacity())
+		{
+			return nullptr;
+		}
+
+		T* page = m_pages[index / g_page_size].load(std::memory_order_acquire);
+		return page ? page + index % g_page_size : nullptr;
+	}
+
+	/**
+	 * @brief Reads an element, falling back to a value-initialized T if its page does not exist
+	 * @param index Element index
+	*/
+	T get(size_t index) const
+	{
+		T* page = m_pages[index / g_page_size].load(std::memory_order_acquire);
+		return page ? page[index % g_page_size] : T();
+	}
+
+	/**
+	 * @brief Accesses an element, allocating its page on demand
+	 * @param index Element index
+	*/
+	T& ensure(size_t index)
+	{
+		assert(index < capacity() && "index is out of range");
+
+		std::atomic<T*>& slot = m_pages[index / g_page_size];
+		T* page = slot.load(std::memory_order_acquire);
+		if (!page)
+		{
+			/// Several threads may race for the same page; the loser frees its copy
+			T* new_page = new T[g_page_size]();
+			if (slot.compare_exchange_strong(page, new_page, std::memory_order_acq_rel))
+			{
+				page = new_page;
+			}
+			else
+			{
+				delete[] new_page;
+			}
+		}
+		return page[index % g_page_size];
+	}
+
+	/**
+	 * @brief Marks the slot as used, allocating its page on demand
+	 * @param index Element index
+	 * @return Reference to the element
+	*/
+	T& acquire(size_t index)
+	{
+		T& element = ensure(index);
+		m_page_usage[index / g_page_size]++;
+		return element;
+	}
+
+	/**
+	 * @brief Resets the slot and frees its page once no slot in it is used anymore
+	 * @param index Element index
+	*/
+	void release(size_t index)
+	{
+		size_t page = index / g_page_size;
+		assert(m_page_usage[page] > 0 && "slot was not acquired");
+
+		(*this)[index] = T();
+		if (--m_page_usage[page] == 0)
+		{
+			delete[] m_pages[page].exchange(nullptr, std::memory_order_acq_rel);
+		}
+	}
+};
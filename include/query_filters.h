@@ -0,0 +1,63 @@
+#pragma once
+#include "utility.h"
+#include <optional>
+
+namespace reflecs
+{
+	namespace filters
+	{
+		/// Skips entities that have any of the components
+		template<typename ... Cs>
+		struct without {};
+
+		/// Matches entities with or without the component; passed as a std::optional handle
+		template<typename C>
+		struct optional
+		{
+			using component = C;
+		};
+
+		/// Matches entities that have at least one of the components
+		template<typename ... Cs>
+		struct any_of
+		{
+			static_assert(sizeof...(Cs) > 0, "any_of needs at least one component");
+		};
+
+		/// Terms that only narrow the query and pass no argument to the function
+		template<typename T>
+		struct is_filter : std::false_type {};
+
+		template<typename ... Cs>
+		struct is_filter<without<Cs...>> : std::true_type {};
+
+		template<typename ... Cs>
+		struct is_filter<any_of<Cs...>> : std::true_type {};
+
+		template<typename T>
+		struct is_optional : std::false_type {};
+
+		template<typename C>
+		struct is_optional<optional<C>> : std::true_type {};
+
+		/// Appends the terms that pass an argument to the list, in order
+		template<typename List, typename ... Ts>
+		struct collect_arguments;
+
+		template<typename ... Us>
+		struct collect_arguments<type_utils::type_list<Us...>>
+		{
+			using type = type_utils::type_list<Us...>;
+		};
+
+		template<typename ... Us, typename T, typename ... Ts>
+		struct collect_arguments<type_utils::type_list<Us...>, T, Ts...>
+			: collect_arguments<std::conditional_t<is_filter<T>::value, type_utils::type_list<Us...>, type_utils::type_list<Us..., T>>, Ts...>
+		{
+		};
+
+		/// type_list of the terms that pass an argument to the function
+		template<typename ... Ts>
+		using argument_terms = typename collect_arguments<type_utils::type_list<>, Ts...>::type;
+	}
+}
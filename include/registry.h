@@ -1,7 +1,14 @@
 #pragma once
 #include "component_manager.h"
-#include <queue>
+#include "thread_pool.h"
+#include "command_buffer.h"
+#include "instrumentation.h"
+#include "component_view.h"
+#include "concurrency.h"
+#include "query_filters.h"
+#include "hierarchy.h"
 #include <mutex>
+#include <string>
 #include <typeindex>
 
 
@@ -10,6 +17,12 @@
  *
  * @brief Entity Component System (ECS) registry class; responsible for managing entities and their components
  *
+ *		  With REFLECS_CONCURRENT_MUTATION enabled, add, remove and destroy may be called from several
+ *		  threads at once. Each change holds the lock of its entity's stripe, then the lock of the
+ *		  component's pool, then a shared lock on the bucket table and the lock of the bucket it
+ *		  leaves or joins; the table is only locked exclusively while a new signature is added.
+ *		  Reading components and iterating must not overlap these calls.
+ *
  * @tparam Cs Components
  */
 template<typename ... Cs>
@@ -18,36 +31,204 @@ class registry
 private:
 	static constexpr size_t m_registered_components = sizeof...(Cs); // Number of registered components
 
+	static constexpr size_t m_invalid_bucket = -1; // Marks unknown bucket transitions and detached entities
+
 	using bit_mask = std::bitset<m_registered_components>;
 
-	std::tuple<component_manager<Cs>...> m_component_pools; // Tuple of component pools
-	std::queue<entity_id> m_available_ids; // Stores available ids
-	std::vector<bit_mask> m_entities_to_signatures; // Maps entities to their assigned components
-	std::unordered_map<bit_mask, std::vector<entity_id>> m_entities; // Maps component signatures to entities containing them them
+	/**
+	 * @brief Entities sharing the same signature, plus the cached transitions to the buckets
+	 *		  reached by adding or removing a single component
+	 */
+	struct signature_bucket
+	{
+		bit_mask signature;
+		std::vector<entity_id> entities;
+		std::array<size_t, m_registered_components> add_edges;
+		std::array<size_t, m_registered_components> remove_edges;
+	};
+
+	/**
+	 * @brief Query terms folded into masks; a bucket either matches as a whole or is skipped,
+	 *		  so filtering costs a few mask tests per bucket
+	 */
+	struct signature_filter
+	{
+		bit_mask required; // Components every matching entity has
+		bit_mask excluded; // Components no matching entity has
+		std::vector<bit_mask> any_of; // Groups of components of which every matching entity has at least one
+
+		bool matches(const bit_mask& signature) const
+		{
+			if ((signature & required) != required || (signature & excluded).any())
+			{
+				return false;
+			}
+			for (const bit_mask& group : any_of)
+			{
+				if ((signature & group).none())
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	/// Contiguous range of entity ids inside a bucket
+	using entity_range = std::pair<const entity_id*, size_t>;
+
+	/// Position of an entity inside the bucket table
+	struct bucket_location
+	{
+		size_t bucket = m_invalid_bucket;
+		size_t row = 0;
+	};
+
+	/**
+	 * @brief Per-entity bookkeeping. While the slot is unused it doubles as a node
+	 *		  of the intrusive free list the entity ids are allocated from.
+	 */
+	struct entity_record
+	{
+		std::atomic<std::uint32_t> generation = 0; // Bumped whenever the slot is freed, which invalidates old ids
+		std::atomic<std::uint32_t> next_free = 0; // Next slot on the free list
+		bit_mask signature; // Assigned components
+		bucket_location location; // Bucket and row within it; detached while the entity has no components
+		bool prefab = false; // Prefabs stay detached so queries skip them
+	};
+
+	static constexpr std::uint32_t m_free_list_end = -1; // Slot index terminating the free list
+
+	/// Receives the ids of the entities that gained or lost a component, as a pointer and a count
+	using observer = std::function<void(const entity_id*, size_t)>;
+
+	/**
+	 * @brief Observers of a component and the membership changes waiting for the next flush
+	 */
+	struct component_observers
+	{
+		std::vector<observer> on_add;
+		std::vector<observer> on_remove;
+		std::vector<std::pair<entity_id, bool>> events; // Entity and whether it gained the component, in the order of the changes
+		std::vector<std::pair<entity_id, bool>> delivering; // Events being delivered; changes made by observers wait for the next flush
+		std::vector<entity_id> added; // Entities that gained the component since the last flush
+		std::vector<entity_id> removed; // Entities that lost the component since the last flush
+		reflecs::concurrency::mutex mutex; // Guards events while entities change on several threads
+	};
+
+	size_t m_capacity; // Maximum number of entities
+	std::atomic<size_t> m_next_index = 0; // First slot that was never handed out
+	std::atomic<std::uint64_t> m_free_head; // Head of the free list; slot index in the low half, ABA tag in the high half
+	std::tuple<component_storage<Cs>...> m_component_pools; // Tuple of component pools; tags get an empty tag_manager
+	paged_array<entity_record> m_entity_records; // Maps entity slots to their records
+	std::vector<signature_bucket> m_buckets; // Buckets are never erased, so indices stay valid; 0 is the empty signature and stays empty
+	std::unordered_map<bit_mask, size_t> m_signatures_to_buckets; // Maps component signatures to their bucket
+	size_t m_uid = next_uid(); // Identifies the registry in the per-thread command buffer lookup
+	std::vector<std::shared_ptr<command_buffer<Cs...>>> m_command_buffers; // One buffer per thread that recorded commands; threads only keep weak references
+	std::mutex m_command_buffers_mutex; // Guards m_command_buffers while a thread registers its buffer
+	std::uint32_t m_tick = 1; // Stamped on component writes of change tracked components
+	reflecs::instrumentation::collector<m_registered_components> m_stats; // Per-thread counters; untouched unless instrumentation is enabled
+	std::array<reflecs::concurrency::mutex, reflecs::concurrency::g_lock_stripes> m_entity_locks; // Serialize the changes of the entities sharing a stripe
+	std::array<reflecs::concurrency::mutex, m_registered_components> m_pool_locks; // One per component pool
+	std::array<reflecs::concurrency::mutex, reflecs::concurrency::g_lock_stripes> m_bucket_locks; // Guard the entity lists of the buckets sharing a stripe
+	reflecs::concurrency::shared_mutex m_buckets_lock; // Shared while the bucket table is used, exclusive while buckets or transitions are added
+	std::unordered_map<std::type_index, std::uint64_t> m_depth_orders; // Pool revisions each depth ordered traversal was last sorted at
+	std::array<component_observers, m_registered_components> m_observers; // Lifecycle observers, per component
+	bit_mask m_observed; // Components with at least one observer; changes of the others are not recorded
 
 public:
 
-	registry()
-		: m_entities_to_signatures(g_max_entities)
+	/**
+	 * @brief Creates an empty registry; storage grows on demand up to the capacity
+	 * @param capacity Maximum number of entities alive at the same time
+	*/
+	explicit registry(size_t capacity = g_max_entities)
+		: m_capacity(std::min<size_t>(capacity, m_free_list_end))
+		, m_free_head(m_free_list_end)
+		, m_component_pools(((void)sizeof(Cs), capacity)...) // Every pool is constructed from the capacity
+		, m_entity_records(m_capacity)
+	{
+		create_bucket(bit_mask());
+	}
+
+	/// Maximum number of entities
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	/**
+	 * @brief Generates new Entity ID. Lock-free; several threads may create entities at once
+	 * @return The new id or g_invalid_entity once the capacity is reached
+	*/
+	entity_id create_entity()
 	{
-		// Populate the queue with entityIDs
-		for (size_t i = 0; i < g_max_entities; ++i)
+		size_t index;
+		if (!pop_free_slot(index))
 		{
-			m_available_ids.push(i);
+			/// Free list is empty; hand out a slot that was never used
+			index = m_next_index.load(std::memory_order_relaxed);
+			do
+			{
+				if (index >= m_capacity)
+				{
+					return g_invalid_entity;
+				}
+			} while (!m_next_index.compare_exchange_weak(index, index + 1, std::memory_order_relaxed));
 		}
+
+		entity_record& record = m_entity_records.ensure(index);
+		record_stats([](auto& counters) { counters.created.add(1); });
+		return reflecs::entity_utils::make_entity_id(index, record.generation.load(std::memory_order_acquire));
 	}
 
-	/// Generates new Entity ID
-	entity_id create_entity()
+	/**
+	 * @brief Creates many entities at once. Recycled slots are used first, the rest is
+	 *		  claimed from the never used slots as one contiguous range. Lock-free.
+	 * @param count Number of entities to create
+	 * @return The new ids; fewer than count once the capacity is reached
+	*/
+	std::vector<entity_id> create_entities(size_t count)
+	{
+		std::vector<entity_id> e_ids;
+		e_ids.reserve(count);
+
+		size_t index;
+		while (e_ids.size() < count && pop_free_slot(index))
+		{
+			e_ids.push_back(reflecs::entity_utils::make_entity_id(index, m_entity_records[index].generation.load(std::memory_order_acquire)));
+		}
+
+		size_t first = m_next_index.load(std::memory_order_relaxed);
+		size_t claimed;
+		do
+		{
+			claimed = std::min(count - e_ids.size(), m_capacity - first);
+		} while (claimed > 0 && !m_next_index.compare_exchange_weak(first, first + claimed, std::memory_order_relaxed));
+
+		for (size_t i = first; i < first + claimed; ++i)
+		{
+			entity_record& record = m_entity_records.ensure(i);
+			e_ids.push_back(reflecs::entity_utils::make_entity_id(i, record.generation.load(std::memory_order_acquire)));
+		}
+		record_stats([&e_ids](auto& counters) { counters.created.add(e_ids.size()); });
+		return e_ids;
+	}
+
+	/**
+	 * @brief Checks whether the id refers to a live entity; ids of destroyed entities are rejected
+	 * @param e_id Entity's ID
+	*/
+	bool valid(entity_id e_id) const
 	{
-		if (m_available_ids.empty())
+		size_t index = reflecs::entity_utils::index_of(e_id);
+		if (index >= m_next_index.load(std::memory_order_acquire))
 		{
-			return -1;
+			return false;
 		}
 
-		size_t new_id = m_available_ids.front();
-		m_available_ids.pop();
-		return new_id;
+		const entity_record* record = m_entity_records.find(index);
+		return record && record->generation.load(std::memory_order_acquire) == reflecs::entity_utils::generation_of(e_id);
 	}
 
 	/**
@@ -56,27 +237,141 @@ public:
 	*/
 	void destroy(entity_id e)
 	{
-		reflecs::constexpr_loop::execute<m_registered_components, remove_entity_wrapper>(this, e, m_entities_to_signatures[e]);
-		m_available_ids.push(e);
+		size_t index = reflecs::entity_utils::index_of(e);
+		std::lock_guard<reflecs::concurrency::mutex> entity_lock(m_entity_locks[index % reflecs::concurrency::g_lock_stripes]);
+		if (!valid(e))
+		{
+			assert(false && "Entity id is invalid or was destroyed");
+			return;
+		}
+
+		entity_record& record = m_entity_records[index];
+
+		bit_mask signature = record.signature;
+		reflecs::constexpr_loop::execute<m_registered_components, remove_entity_wrapper>(this, index, signature);
+		record_events(e, signature, false);
+
+		if (record.location.bucket != m_invalid_bucket)
+		{
+			detach(e);
+		}
+		record.signature.reset();
+		record.prefab = false;
+
+		/// Outdate every id of the slot before it can be handed out again
+		record.generation.fetch_add(1, std::memory_order_release);
+		push_free_slot(index);
+		record_stats([](auto& counters) { counters.destroyed.add(1); });
+	}
+
+	/**
+	 * @brief Turns the entity into a prefab: it keeps its components, which may still be changed,
+	 *		  but leaves its bucket, so queries no longer visit it. Observers see it lose its
+	 *		  components and are not told about its later changes. Destroy it like any entity.
+	 * @param e_id Entity's ID
+	*/
+	void make_prefab(entity_id e_id)
+	{
+		size_t index = reflecs::entity_utils::index_of(e_id);
+		std::lock_guard<reflecs::concurrency::mutex> entity_lock(m_entity_locks[index % reflecs::concurrency::g_lock_stripes]);
+		if (!valid(e_id))
+		{
+			assert(false && "Entity id is invalid or was destroyed");
+			return;
+		}
+
+		entity_record& record = m_entity_records[index];
+		if (record.prefab)
+		{
+			return;
+		}
+		if (record.location.bucket != m_invalid_bucket)
+		{
+			detach(e_id);
+		}
+		record_events(e_id, record.signature, false);
+		record.prefab = true;
+
+		/// Prefabs leave the depth order, as children and as parents, so hierarchies are sorted again
+		constexpr size_t link_id = reflecs::type_utils::get_component_type_id<parent_link, Cs...>();
+		if constexpr (link_id != size_t(-1))
+		{
+			std::lock_guard<reflecs::concurrency::mutex> pool_lock(m_pool_locks[link_id]);
+			retrieve_pool<parent_link>().bump_revision();
+		}
+	}
+
+	/**
+	 * @brief Creates entities with copies of every component of a template entity, usually a prefab.
+	 *		  Each pool gets back to back instances whose columns are filled with the template's
+	 *		  fields, and the clones join the bucket of the template's signature in one go.
+	 *		  The template must not change while it is instantiated.
+	 * @param prefab Template entity's ID
+	 * @param count Number of clones
+	 * @return Ids of the clones; fewer than count once the capacity is reached
+	*/
+	std::vector<entity_id> instantiate(entity_id prefab, size_t count)
+	{
+		if (!valid(prefab))
+		{
+			assert(false && "Entity id is invalid or was destroyed");
+			return {};
+		}
+
+		std::vector<entity_id> e_ids = create_entities(count);
+		std::vector<entity_id> indices(e_ids.size());
+		for (size_t i = 0; i < e_ids.size(); ++i)
+		{
+			indices[i] = reflecs::entity_utils::index_of(e_ids[i]);
+		}
+
+		size_t prefab_index = reflecs::entity_utils::index_of(prefab);
+		bit_mask signature = m_entity_records[prefab_index].signature;
+		reflecs::constexpr_loop::execute<m_registered_components, copy_component_wrapper>(this, prefab_index, signature, indices);
+
+		for (entity_id e_id : e_ids)
+		{
+			m_entity_records[reflecs::entity_utils::index_of(e_id)].signature = signature;
+			record_events(e_id, signature, true);
+		}
+
+		/// Entities without components are not stored in a bucket
+		size_t bucket = find_bucket(0, signature);
+		if (bucket != 0 && !e_ids.empty())
+		{
+			std::shared_lock<reflecs::concurrency::shared_mutex> table_lock(m_buckets_lock);
+			std::lock_guard<reflecs::concurrency::mutex> bucket_lock(m_bucket_locks[bucket % reflecs::concurrency::g_lock_stripes]);
+
+			std::vector<entity_id>& entities = m_buckets[bucket].entities;
+			entities.reserve(entities.size() + e_ids.size());
+			for (entity_id e_id : e_ids)
+			{
+				m_entity_records[reflecs::entity_utils::index_of(e_id)].location = { bucket, entities.size() };
+				entities.push_back(e_id);
+			}
+		}
+		return e_ids;
 	}
 
 	/**
 	* @brief Fetches entity data for a specified set of components
 	*
 	* @tparam C Current component type used in creating a handle
-	* @tparam ...Cs Remaining Components
+	* @tparam ...Ts Remaining Components
 	*/
-	template<typename C, typename ... Cs>
+	template<typename C, typename ... Ts>
 	auto unpack(entity_id e_id)
 	{
+		assert(valid(e_id) && "Entity id is invalid or was destroyed");
+
 		// Recusively concatenates a tuple at compile-time until the size of the tail hits 0
-		if constexpr (sizeof...(Cs) < 1)
+		if constexpr (sizeof...(Ts) < 1)
 		{
 			return std::make_tuple(create_handle<C>(e_id));
 		}
 		else
 		{
-			return std::tuple_cat(std::make_tuple(create_handle<C>(e_id)), unpack<Cs...>(e_id));
+			return std::tuple_cat(std::make_tuple(create_handle<C>(e_id)), unpack<Ts...>(e_id));
 		}
 	}
 
@@ -91,126 +386,2384 @@ public:
 	template<typename C, typename ... Args>
 	void add(entity_id e_id, Args&& ... args)
 	{
-		if (e_id == -1)
+		static_assert(!reflecs::component_reflection::is_tag<C>::value || sizeof...(Args) == 0, "Tags are added without data");
+
+		bool added = change_component<C>(e_id, true, [&](auto& pool, size_t e_index)
+			{
+				pool.add(e_index, std::forward<Args>(args)...);
+			}
+		);
+		if (!added)
+		{
+			assert(false && "Entity id is invalid or was destroyed");
+			return;
+		}
+		record_stats([](auto& counters) { counters.adds[reflecs::type_utils::get_component_type_id<C, Cs...>()].add(1); });
+	}
+
+	/**
+	* @brief Adds components to many entities from one array of constructed components per
+	*		 component type, e.g. add<transform, velocity>(e_ids, count, transforms, velocities).
+	*		 The final signature is computed once, so every entity moves to its bucket a single
+	*		 time no matter how many components it gains.
+	*
+	* @tparam Ts - Components
+	*
+	* @param e_ids - Entities' ids
+	* @param count - Number of entities
+	* @param components - count components per component type, one per entity; ignored for tags
+	*/
+	template<typename ... Ts>
+	void add(const entity_id* e_ids, size_t count, const Ts* ... components)
+	{
+		static_assert(sizeof...(Ts) > 0, "Add at least one component");
+
+		if constexpr (reflecs::concurrency::enabled)
 		{
+			size_t added = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				bool valid_id = add_under_lock<Ts...>(e_ids[i], i, components...);
+				assert(valid_id && "Entity id is invalid or was destroyed");
+				added += valid_id;
+			}
+			record_stats([added](auto& counters) { (counters.adds[reflecs::type_utils::get_component_type_id<Ts, Cs...>()].add(added), ...); });
 			return;
 		}
 
-		component_manager<C>& mgr = retrieve_pool<C>();
+		std::vector<entity_id> indices;
+		if (!collect_indices(e_ids, count, indices))
+		{
+			return;
+		}
+
+		(add_components<Ts>(indices.data(), count, components), ...);
+		record_stats([count](auto& counters) { (counters.adds[reflecs::type_utils::get_component_type_id<Ts, Cs...>()].add(count), ...); });
+		update_mask_batch<Ts...>(e_ids, count);
+	}
+
+	/**
+	* @brief Adds a component to many entities from one array per field;
+	*		 new instances are filled with a memcpy per field
+	*
+	* @tparam C - Component
+	* @tparam Fields - Field types in declaration order
+	*
+	* @param e_ids - Entities' ids
+	* @param count - Number of entities
+	* @param columns - One array of count elements per field; none for tags
+	*/
+	template<typename C, typename ... Fields>
+	void add_columns(const entity_id* e_ids, size_t count, const Fields* ... columns)
+	{
+		if constexpr (reflecs::concurrency::enabled)
+		{
+			add_one_by_one<C>(e_ids, count, [columns...](auto& pool, const entity_id* e_index, size_t i)
+				{
+					pool.add_columns(e_index, 1, (columns + i)...);
+				}
+			);
+			return;
+		}
 
-		mgr.add(e_id, std::forward<Args>(args)...);
+		std::vector<entity_id> indices;
+		if (!collect_indices(e_ids, count, indices))
+		{
+			return;
+		}
 
-		update_mask<C>(e_id, true);
+		if constexpr (reflecs::component_reflection::is_tag<C>::value)
+		{
+			static_assert(sizeof...(Fields) == 0, "Tags have no columns");
+		}
+		else
+		{
+			retrieve_pool<C>().add_columns(indices.data(), count, columns...);
+		}
+		record_stats([count](auto& counters) { counters.adds[reflecs::type_utils::get_component_type_id<C, Cs...>()].add(count); });
+		update_mask_batch<C>(e_ids, count);
 	}
 
 	/**
 	* @brief Function to iterate over entity vectors
 	*		 that have the specified set of components.
+	*		 Besides components, Ts may hold filters::without<...> and filters::any_of<...>
+	*		 terms, which narrow the matching buckets and pass no argument, and
+	*		 filters::optional<C> terms, which pass a std::optional handle, e.g.
+	*		 for_each<transform, without<frozen>, optional<color>>(function(entity_id, handle, std::optional<handle>)).
+	*		 Every term is resolved against the bucket signatures, so excluded buckets are skipped whole.
 	*
-	* @tparam ... Cs  Components
+	* @tparam ... Ts  Components and query terms
 	* @tparam F Function type
 	* @param function Function object (lambda/functor)
 	*/
-	template<typename ... Cs, typename F>
+	template<typename ... Ts, typename F>
 	void for_each(F&& function)
 	{
-		static auto target_mask = create_signature<Cs...>();
+		static const signature_filter filter = create_filter<Ts...>();
+		auto timer = time_query<Ts...>();
 
-		for (auto& [bit_mask, entity_vec] : m_entities)
+		for (auto& bucket : m_buckets)
 		{
-			if ((bit_mask & target_mask) != target_mask)
+			if (!filter.matches(bucket.signature))
 			{
 				continue;
 			}
-			for (auto entity_id : entity_vec)
+			timer.count(bucket.entities.size());
+			visit_bucket<Ts...>(bucket, function);
+		}
+	}
+
+	/**
+	* @brief Iterates over entities with the specified set of components in contiguous chunks.
+	*		 A chunk is a run of entities whose instances are consecutive in every requested pool,
+	*		 so each field of the chunk is a plain array. The function receives a pointer per field
+	*		 of every component (in declaration order) followed by the chunk length,
+	*		 e.g. function(float* x, float* y, float* w, float* h, float* vx, float* vy, size_t n).
+	*
+	* @tparam ... Ts  Components, plus without and any_of terms
+	* @tparam F Function type
+	* @param function Function object (lambda/functor)
+	*/
+	template<typename ... Ts, typename F>
+	void for_each_chunk(F&& function)
+	{
+		static const signature_filter filter = create_filter<Ts...>();
+		auto timer = time_query<Ts...>();
+
+		for (auto& bucket : m_buckets)
+		{
+			if (!filter.matches(bucket.signature))
 			{
-				function(entity_id, create_handle<Cs>(entity_id)...);
+				continue;
 			}
+			timer.count(bucket.entities.size());
+			visit_bucket_chunks(bucket, function, reflecs::filters::argument_terms<Ts...>());
 		}
 	}
 
 	/**
-	 * @brief Removes entity from the component pool
-	 * @tparam C Component
-	 * @param e_id Entity's ID
+	* @brief Same as for_each, but hands out generated component_view handles instead of
+	*		 component_handle. The field base pointers are resolved once per contiguous run
+	*		 of instances, so the loop compiles like a hand-written SoA loop.
+	*		 Components listed as const are read-only, e.g. for_each_view<transform, const velocity>.
+	*
+	* @tparam ... Ts  Components, optionally const, plus without and any_of terms
+	* @tparam F Function type
+	* @param function Function object invoked as function(entity_id, component_view<Ts>...)
 	*/
-	template<typename C>
-	void remove(entity_id e_id)
+	template<typename ... Ts, typename F>
+	void for_each_view(F&& function)
 	{
-		component_manager<C>& mgr = retrieve_pool<C>();
-		mgr.remove(e_id);
+		static const signature_filter filter = create_filter<std::remove_const_t<Ts>...>();
+		auto timer = time_query<std::remove_const_t<Ts>...>();
 
-		update_mask<C>(e_id, false);
+		for (auto& bucket : m_buckets)
+		{
+			if (!filter.matches(bucket.signature))
+			{
+				continue;
+			}
+			timer.count(bucket.entities.size());
+			visit_bucket_views(bucket, function, reflecs::filters::argument_terms<Ts...>());
+		}
 	}
 
-private:
 	/**
-	 * @brief Removes/Adds component's ID to entity's component bit mask
-	 * @tparam C Component
-	 * @param e_id Entity's ID
-	 * @param add Set or unset the bit
+	* @brief Parallel version of for_each. Matching signature buckets are split into
+	*		 chunks of at most grain_size entities which are processed on the thread pool.
+	*		 The function may only write to the components of the entity it was invoked for
+	*		 and must not add, remove or destroy anything.
+	*
+	* @tparam ... Ts  Components and query terms
+	* @tparam F Function type
+	* @param pool Thread pool executing the chunks
+	* @param function Function object (lambda/functor)
+	* @param grain_size Maximum number of entities processed by a single task
 	*/
-	template<typename C>
-	void update_mask(entity_id e_id, bool add)
+	template<typename ... Ts, typename F>
+	void par_for_each(thread_pool& pool, F&& function, size_t grain_size = g_default_grain_size)
+	{
+		static const signature_filter filter = create_filter<Ts...>();
+		auto timer = time_query<Ts...>();
+
+		/// Split the matching buckets into chunks so a task never spans two buckets
+		std::vector<entity_range> chunks;
+		for (auto& bucket : m_buckets)
+		{
+			if (!filter.matches(bucket.signature))
+			{
+				continue;
+			}
+			timer.count(bucket.entities.size());
+			split_bucket(bucket, grain_size, chunks);
+		}
+
+		run_parallel<Ts...>(pool, chunks, function);
+	}
+
+	/**
+	* @brief Visits the entities whose component C was written after the given tick and that
+	*		 also have the components Ts. C must opt into change tracking. Walks C's pool
+	*		 instead of the buckets and skips pages without recent writes, so the cost follows
+	*		 the number of changed entities rather than the number of matching ones.
+	*
+	* @tparam C Change tracked component
+	* @tparam ... Ts Additional components and query terms
+	* @tparam F Function type
+	* @param since Tick returned by an earlier advance_tick(); 0 visits every entity with C
+	* @param function Function object (lambda/functor)
+	*/
+	template<typename C, typename ... Ts, typename F>
+	void for_each_changed(std::uint32_t since, F&& function)
 	{
-		auto s = m_entities_to_signatures[e_id];
-		m_entities[s].erase(std::remove(m_entities[s].begin(), m_entities[s].end(), e_id), m_entities[s].end());
-		s.set(reflecs::type_utils::get_component_type_id<C, Cs...>(), add);
-		m_entities_to_signatures[e_id] = s;
-		m_entities[s].push_back(e_id);
+		static const signature_filter filter = create_filter<C, Ts...>();
+		auto timer = time_query<C, Ts...>();
+
+		retrieve_pool<C>().for_each_changed(since, [&](size_t e_index)
+			{
+				entity_record& record = m_entity_records[e_index];
+				if (record.prefab || !filter.matches(record.signature))
+				{
+					return;
+				}
+
+				entity_id e_id = reflecs::entity_utils::make_entity_id(e_index, record.generation.load(std::memory_order_relaxed));
+				timer.count(1);
+				invoke_terms<Ts...>(function, e_id, create_handle<C>(e_id));
+			}
+		);
 	}
 
 	/**
-	* @brief Creates a bit mask for the given set of components
+	* @brief Visits the entities whose field of component C lies in [lo, hi] and that also have the
+	*		 components Ts, in ascending order of the field. The field must declare a range index;
+	*		 its sorted index is rebuilt on the first query after C was written, so a query costs
+	*		 O(log N + k) while the component is left alone.
 	*
-	* @tparams ...Cs Components
+	* @tparam C Component
+	* @tparam index Index of the member in the component by order
+	* @tparam ... Ts Additional components and query terms
+	* @tparam F Function type
+	* @param lo Smallest value to visit
+	* @param hi Largest value to visit
+	* @param function Function object invoked as function(entity_id, component_handle<C>, component_handle<Ts>...)
 	*/
-	template<typename ... Ts>
-	constexpr auto create_signature()
+	template<typename C, size_t index, typename ... Ts, typename F>
+	void query_range(const typename reflecs::component_reflection::get_type<C, index>::type& lo, const typename reflecs::component_reflection::get_type<C, index>::type& hi, F&& function)
 	{
-		bit_mask signatures;
+		static const signature_filter filter = create_filter<C, Ts...>();
+		auto timer = time_query<C, Ts...>();
 
-		(signatures.set(reflecs::type_utils::get_component_type_id<Ts, Cs...>()), ...); // fold expresion since C++ 17; applies same operation for all template aruments 
-		return signatures;
+		retrieve_pool<C>().template for_each_in_range<index>(lo, hi, [&](size_t e_index)
+			{
+				entity_record& record = m_entity_records[e_index];
+				if (record.prefab || !filter.matches(record.signature))
+				{
+					return;
+				}
+
+				entity_id e_id = reflecs::entity_utils::make_entity_id(e_index, record.generation.load(std::memory_order_relaxed));
+				timer.count(1);
+				invoke_terms<Ts...>(function, e_id, create_handle<C>(e_id));
+			}
+		);
 	}
 
 	/**
-	* @brief Creates a handle for a components to access its fields.
-	* Component handle needs to be partially specialized and defined to work
+	* @brief Visits the entities with component C parents first, in breadth-first order of their
+	*		 depth in the parent_link hierarchy. An entity is a root if it has no parent_link or its
+	*		 parent was destroyed, is a prefab or lacks C. Whenever links or the pools changed since the last call,
+	*		 the instances of C, parent_link and the components among Ts are first moved into that
+	*		 order, so a propagation pass such as computing world transforms sweeps C's columns
+	*		 front to back and finds each parent's data just behind it.
+	*		 Requires parent_link to be registered. Since it may move instances, it must not run
+	*		 alongside other queries over these components.
+	*
+	* @tparam C Component propagated from parents to children
+	* @tparam ... Ts Additional components and query terms
+	* @tparam F Function type
+	* @param function Function object invoked as function(entity_id, component_handle<C>, std::optional<component_handle<C>> parent, component_handle<Ts>...)
+	*/
+	template<typename C, typename ... Ts, typename F>
+	void for_each_in_depth_order(F&& function)
+	{
+		static_assert(!reflecs::component_reflection::is_tag<C>::value, "Tags have no data to propagate");
+		static const signature_filter filter = create_filter<C, Ts...>();
+		auto timer = time_query<C, Ts...>();
+
+		sort_by_depth<C>(reflecs::filters::argument_terms<Ts...>());
+
+		component_manager<C>& pool = retrieve_pool<C>();
+		for (component_instance instance = 1; instance <= pool.size(); ++instance)
+		{
+			size_t e_index = pool.owner_of(instance);
+			entity_record& record = m_entity_records[e_index];
+			if (record.prefab || !filter.matches(record.signature))
+			{
+				continue;
+			}
+
+			std::optional<component_handle<C>> parent;
+			component_instance parent_instance = parent_instance_of<C>(e_index);
+			if (parent_instance != 0)
+			{
+				parent.emplace(pool, parent_instance);
+			}
+
+			entity_id e_id = reflecs::entity_utils::make_entity_id(e_index, record.generation.load(std::memory_order_relaxed));
+			timer.count(1);
+			invoke_terms<Ts...>(function, e_id, component_handle<C>(pool, instance), parent);
+		}
+	}
+
+	/**
+	* @brief Marks a component of the entity as changed, e.g. after writing it through for_each_chunk.
+	*		 Needed for change tracking and range indices.
 	*
 	* @tparam C Component
+	* @param e_id Entity's id
 	*/
 	template<typename C>
-	component_handle<C> create_handle(entity_id e_id)
+	void mark_changed(entity_id e_id)
 	{
+		static_assert(!reflecs::component_reflection::is_tag<C>::value, "Tags have no data to change");
+		assert(valid(e_id) && "Entity id is invalid or was destroyed");
+
 		component_manager<C>& mgr = retrieve_pool<C>();
+		component_instance instance = mgr.look_up(reflecs::entity_utils::index_of(e_id));
+		if (instance == 0)
+		{
+			assert(false && "Entity does not have the component");
+			return;
+		}
+		mgr.mark_changed(instance);
+	}
 
-		return mgr.retrieve(e_id);
+	/// Tick stamped on writes made from now on
+	std::uint32_t tick() const
+	{
+		return m_tick;
 	}
 
 	/**
-	 * @brief Returns a pointer to the pool of a component's type
-	 * @tparam C Component
-	 * @return Component pool pointer
+	 * @brief Starts a new tick. Must not be called while iterating.
+	 * @return The tick that ended; pass it to for_each_changed later to see every write made after this call
 	*/
-	template<typename C>
-	component_manager<C>& retrieve_pool()
+	std::uint32_t advance_tick()
 	{
-		return std::get<component_manager<C>>(m_component_pools);
+		std::uint32_t ended = m_tick++;
+		std::apply([this](auto& ... pools) { (pools.set_tick(m_tick), ...); }, m_component_pools);
+		return ended;
 	}
 
 	/**
-	 * @brief Compile-time helper method to remove the entity from assigned pool
-	 * @tparam Position of a bit in a bit_mask
-	 * @param e_id Entity's ID
-	 * @param bit_mask Entity's bit mask
-	*/
-	template<size_t index>
-	void remove_entity_from_pool(entity_id e_id, bit_mask& bit_mask)
+	 * @class query
+	 *
+	 * @brief Persistent query over entities matching the specified components and query terms.
+	 *		  It remembers the buckets whose signature matches and only inspects buckets
+	 *		  created since it was last used, so running it costs nothing extra
+	 *		  while the set of signatures in the registry is stable.
+	 *
+	 * @tparam ... Ts Components and query terms
+	 */
+	template<typename ... Ts>
+	class query
 	{
-		if (bit_mask[index])
+	private:
+		registry& m_registry;
+		signature_filter m_filter;
+		std::vector<size_t> m_matching_buckets; // Indices of the buckets with a matching signature
+		size_t m_known_buckets = 0; // Number of buckets that were already checked
+
+	public:
+
+		explicit query(registry& owner)
+			: m_registry(owner)
+			, m_filter(owner.template create_filter<Ts...>())
 		{
-			remove<reflecs::type_utils::component_type_at_index<index, Cs...>>(e_id);
+		}
+
+		/**
+		* @brief Same as registry::for_each
+		* @param function Function object (lambda/functor)
+		*/
+		template<typename F>
+		void for_each(F&& function)
+		{
+			refresh();
+			auto timer = m_registry.template time_query<Ts...>();
+			for (size_t bucket : m_matching_buckets)
+			{
+				timer.count(m_registry.m_buckets[bucket].entities.size());
+				m_registry.template visit_bucket<Ts...>(m_registry.m_buckets[bucket], function);
+			}
+		}
+
+		/**
+		* @brief Same as registry::for_each_chunk
+		* @param function Function object (lambda/functor)
+		*/
+		template<typename F>
+		void for_each_chunk(F&& function)
+		{
+			refresh();
+			auto timer = m_registry.template time_query<Ts...>();
+			for (size_t bucket : m_matching_buckets)
+			{
+				timer.count(m_registry.m_buckets[bucket].entities.size());
+				m_registry.visit_bucket_chunks(m_registry.m_buckets[bucket], function, reflecs::filters::argument_terms<Ts...>());
+			}
+		}
+
+		/**
+		* @brief Same as registry::for_each_view
+		* @param function Function object (lambda/functor)
+		*/
+		template<typename F>
+		void for_each_view(F&& function)
+		{
+			refresh();
+			auto timer = m_registry.template time_query<Ts...>();
+			for (size_t bucket : m_matching_buckets)
+			{
+				timer.count(m_registry.m_buckets[bucket].entities.size());
+				m_registry.visit_bucket_views(m_registry.m_buckets[bucket], function, reflecs::filters::argument_terms<Ts...>());
+			}
+		}
+
+		/**
+		* @brief Same as registry::par_for_each
+		* @param pool Thread pool executing the chunks
+		* @param function Function object (lambda/functor)
+		* @param grain_size Maximum number of entities processed by a single task
+		*/
+		template<typename F>
+		void par_for_each(thread_pool& pool, F&& function, size_t grain_size = g_default_grain_size)
+		{
+			refresh();
+			auto timer = m_registry.template time_query<Ts...>();
+
+			std::vector<entity_range> chunks;
+			for (size_t bucket : m_matching_buckets)
+			{
+				timer.count(m_registry.m_buckets[bucket].entities.size());
+				m_registry.split_bucket(m_registry.m_buckets[bucket], grain_size, chunks);
+			}
+
+			m_registry.template run_parallel<Ts...>(pool, chunks, function);
+		}
+
+		/// Number of entities matching the query
+		size_t size()
+		{
+			refresh();
+
+			size_t count = 0;
+			for (size_t bucket : m_matching_buckets)
+			{
+				count += m_registry.m_buckets[bucket].entities.size();
+			}
+			return count;
+		}
+
+	private:
+
+		/// Picks up the buckets created since the last call
+		void refresh()
+		{
+			for (; m_known_buckets < m_registry.m_buckets.size(); ++m_known_buckets)
+			{
+				const bit_mask& signature = m_registry.m_buckets[m_known_buckets].signature;
+				if (m_filter.matches(signature))
+				{
+					m_matching_buckets.push_back(m_known_buckets);
+				}
+			}
+		}
+	};
+
+	/**
+	* @brief Creates a persistent query; keep it around and reuse it every tick
+	*
+	* @tparam ... Ts  Components
+	*/
+	template<typename ... Ts>
+	query<Ts...> create_query()
+	{
+		return query<Ts...>(*this);
+	}
+
+	/**
+	 * @brief Removes entity from the component pool
+	 * @tparam C Component
+	 * @param e_id Entity's ID
+	*/
+	template<typename C>
+	void remove(entity_id e_id)
+	{
+		bool removed = change_component<C>(e_id, false, [](auto& pool, size_t e_index)
+			{
+				pool.remove(e_index);
+			}
+		);
+		if (!removed)
+		{
+			assert(false && "Entity id is invalid or was destroyed");
+			return;
+		}
+		record_stats([](auto& counters) { counters.removes[reflecs::type_utils::get_component_type_id<C, Cs...>()].add(1); });
+	}
+
+	/**
+	 * @brief Returns the calling thread's command buffer. Structural changes recorded in it
+	 *		  are applied by flush(), which makes it safe to use from inside for_each and par_for_each.
+	 *		  A thread's adds and removes are applied in the order it recorded them.
+	 *		  create_entity may be called directly while iterating.
+	*/
+	command_buffer<Cs...>& commands()
+	{
+		/// Buffers of this thread, keyed by registry uid; the weak reference expires with the registry
+		static thread_local std::vector<std::tuple<size_t, command_buffer<Cs...>*, std::weak_ptr<command_buffer<Cs...>>>> t_buffers;
+
+		for (auto& [uid, buffer, owner] : t_buffers)
+		{
+			if (uid == m_uid)
+			{
+				return *buffer;
+			}
+		}
+
+		/// Drop the buffers of destroyed registries before adding this one
+		t_buffers.erase(std::remove_if(t_buffers.begin(), t_buffers.end(), [](const auto& entry) { return std::get<2>(entry).expired(); }), t_buffers.end());
+
+		std::lock_guard<std::mutex> lock(m_command_buffers_mutex);
+		m_command_buffers.push_back(std::make_shared<command_buffer<Cs...>>());
+		t_buffers.emplace_back(m_uid, m_command_buffers.back().get(), m_command_buffers.back());
+		return *m_command_buffers.back();
+	}
+
+	/**
+	 * @brief Applies the commands recorded by every thread and clears the buffers.
+	 *		  Destroys are applied first. Then the adds and removes of each buffer are replayed
+	 *		  in the order they were recorded, so the last command recorded for an entity and
+	 *		  component wins; buffers of different threads are applied one after another. Each
+	 *		  entity changes buckets at most once, no matter how many components it gained or lost.
+	 *		  Afterwards the membership changes collected since the last flush, including those
+	 *		  made directly, are delivered to the observers registered with on_add and on_remove.
+	 *		  Must not be called while iterating, recording or changing entities on other threads.
+	*/
+	void flush()
+	{
+		std::vector<entity_id> touched; // Entities whose signature no longer matches their bucket
+
+		for (auto& buffer : m_command_buffers)
+		{
+			for (entity_id e_id : buffer->m_destroys)
+			{
+				if (valid(e_id))
+				{
+					destroy(e_id);
+				}
+			}
+		}
+
+		for (auto& buffer : m_command_buffers)
+		{
+			reflecs::constexpr_loop::execute<m_registered_components, flush_commands_wrapper>(this, *buffer, touched);
+		}
+
+		for (entity_id e_id : touched)
+		{
+			migrate(e_id);
+		}
+
+		for (auto& buffer : m_command_buffers)
+		{
+			buffer->clear();
+		}
+
+		for (size_t component_id = 0; component_id < m_registered_components; ++component_id)
+		{
+			deliver_events(m_observers[component_id]);
+		}
+	}
+
+	/**
+	 * @brief Registers an observer of entities gaining the component. The changes are collected
+	 *		  and delivered by flush() in one batch per component, so the structural calls only
+	 *		  append to a list. Every entity is reported once with its net change since the last
+	 *		  flush: an entity that gained and lost the component in between is not reported.
+	 *		  Must not be called while entities change on other threads.
+	 * @tparam C Component
+	 * @param function Invoked as function(const entity_id* e_ids, size_t count)
+	*/
+	template<typename C, typename F>
+	void on_add(F&& function)
+	{
+		constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+		m_observers[component_id].on_add.emplace_back(std::forward<F>(function));
+		m_observed.set(component_id);
+	}
+
+	/**
+	 * @brief Registers an observer of entities losing the component, by remove or destroy.
+	 *		  Delivered like on_add; removals are delivered before additions.
+	 * @tparam C Component
+	 * @param function Invoked as function(const entity_id* e_ids, size_t count)
+	*/
+	template<typename C, typename F>
+	void on_remove(F&& function)
+	{
+		constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+		m_observers[component_id].on_remove.emplace_back(std::forward<F>(function));
+		m_observed.set(component_id);
+	}
+
+	/**
+	 * @brief Replaces the source of a component pool's field pages. Must be called before
+	 *		  the component is added to any entity.
+	 * @tparam C Component
+	 * @param allocator New page allocator
+	*/
+	template<typename C>
+	void set_page_allocator(std::unique_ptr<reflecs::storage::page_allocator> allocator)
+	{
+		retrieve_pool<C>().set_allocator(std::move(allocator));
+	}
+
+	/**
+	 * @brief Backs a component pool with a memory-mapped file, so the pool may grow beyond
+	 *		  physical memory and cold pages are paged in on demand. The file grows and shrinks
+	 *		  with the pool and holds its field pages; checkpoint() records the rest, so after a
+	 *		  restart mapping the pool to the same file and calling load() reattaches the pages
+	 *		  without copying them. Must be called before the component is added to any entity.
+	 * @tparam C Component
+	 * @param path File path; an existing file is kept for load() and discarded once the pool allocates instead
+	 * @return False if the file can not be created or memory mapping is not available
+	*/
+	template<typename C>
+	bool map_pool(const char* path)
+	{
+#if REFLECS_HAS_MMAP
+		auto allocator = reflecs::storage::file_page_allocator::open(path, retrieve_pool<C>().page_bytes());
+		if (!allocator)
+		{
+			return false;
+		}
+		set_page_allocator<C>(std::move(allocator));
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Writes the modified pages of file-backed pools to their files, e.g. to bound the
+	 *		  dirty memory the kernel holds; checkpoint() also records what is needed to reattach them
+	 * @param wait Block until the data is on disk instead of only scheduling the writes
+	 * @return Whether every pool synced
+	*/
+	bool sync(bool wait = true)
+	{
+		return std::apply([wait](auto& ... pools) { return (pools.sync(wait) & ...); }, m_component_pools);
+	}
+
+	/**
+	 * @brief Writes the registry to a binary snapshot: every pool's field pages and index maps,
+	 *		  the entity records with the free list, and the signature buckets, each as a
+	 *		  contiguous section. Commands that were not flushed yet are not saved.
+	 *		  Must not be called while iterating or flushing.
+	 * @param path File path
+	 * @return Whether the file was written completely
+	*/
+	bool save(const char* path) const
+	{
+		reflecs::snapshot::writer out(path);
+		write_snapshot(out, false);
+		return out.close();
+	}
+
+	/**
+	 * @brief Makes the registry restorable after a restart without copying file-backed pools:
+	 *		  their pages are synced to their files, and the snapshot only records how many pages
+	 *		  each pool uses next to the index maps, entity records and buckets. The snapshot is
+	 *		  written beside the path and renamed over it once on disk, so a crash keeps the
+	 *		  previous checkpoint. To restore, map the same pools to the same files and call load().
+	 *		  Writes made after the checkpoint reach the pool files too; a structural change that
+	 *		  moves instances makes them disagree with the checkpoint until the next one.
+	 *		  Must not be called while iterating or flushing.
+	 * @param path File path of the snapshot
+	 * @return Whether the pages were synced and the snapshot was written completely
+	*/
+	bool checkpoint(const char* path)
+	{
+		if (!sync(true))
+		{
+			return false;
+		}
+
+		std::string temporary = std::string(path) + ".tmp";
+		reflecs::snapshot::writer out(temporary.c_str());
+		write_snapshot(out, true);
+		return out.close(true) && std::rename(temporary.c_str(), path) == 0;
+	}
+
+	/**
+	 * @brief Restores a snapshot written by save() or checkpoint() into this registry, which must
+	 *		  be empty and have room for the saved entities. The file is memory mapped and the
+	 *		  component pages are used in place, so they are only read from disk once touched.
+	 *		  Pools a checkpoint left in their files are reattached to them; they must be mapped
+	 *		  with map_pool to the same files first.
+	 *		  If loading fails after the header was accepted, the registry must be discarded.
+	 * @param path File path
+	 * @return False if the file can not be read, was written by a registry with other components,
+	 *		   or refers to pool files that are not mapped or are too short
+	*/
+	bool load(const char* path)
+	{
+		if (m_next_index.load(std::memory_order_acquire) != 0)
+		{
+			assert(false && "Snapshots can only be loaded into an empty registry");
+			return false;
+		}
+
+		std::shared_ptr<reflecs::snapshot::mapping> file = reflecs::snapshot::mapping::open(path);
+		if (!file)
+		{
+			return false;
+		}
+		reflecs::snapshot::reader in(file);
+
+		reflecs::snapshot::header header;
+		if (!in.read_value(header) || header.magic != reflecs::snapshot::g_magic || header.version != reflecs::snapshot::g_version
+			|| header.components != m_registered_components || header.page_size != g_page_size || header.entities > m_capacity)
+		{
+			return false;
+		}
+
+		const char* generations = in.take(header.entities * sizeof(std::uint32_t));
+		const char* next_free = in.take(header.entities * sizeof(std::uint32_t));
+		if (!generations || !next_free)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < header.entities; ++i)
+		{
+			std::uint32_t generation, next;
+			std::memcpy(&generation, generations + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+			std::memcpy(&next, next_free + i * sizeof(std::uint32_t), sizeof(std::uint32_t));
+
+			entity_record& record = m_entity_records.ensure(i);
+			record.generation.store(generation, std::memory_order_relaxed);
+			record.next_free.store(next, std::memory_order_relaxed);
+			if (!reflecs::snapshot::read_bits(in, record.signature))
+			{
+				return false;
+			}
+		}
+
+		std::uint64_t bucket_count;
+		if (!in.read_value(bucket_count) || bucket_count == 0)
+		{
+			return false;
+		}
+		for (size_t bucket = 0; bucket < bucket_count; ++bucket)
+		{
+			bit_mask signature;
+			std::uint64_t size;
+			if (!reflecs::snapshot::read_bits(in, signature) || !in.read_value(size))
+			{
+				return false;
+			}
+
+			const char* entities = in.take(size * sizeof(entity_id));
+			if (!entities || (bucket == 0) != signature.none() || (bucket == 0 && size > 0))
+			{
+				return false;
+			}
+			if (bucket > 0)
+			{
+				create_bucket(signature);
+			}
+
+			std::vector<entity_id>& bucket_entities = m_buckets[bucket].entities;
+			bucket_entities.resize(size);
+			if (size > 0)
+			{
+				std::memcpy(bucket_entities.data(), entities, size * sizeof(entity_id));
+			}
+			for (size_t row = 0; row < size; ++row)
+			{
+				size_t index = reflecs::entity_utils::index_of(bucket_entities[row]);
+				if (index >= header.entities)
+				{
+					return false;
+				}
+				m_entity_records[index].location = { bucket, row };
+			}
+		}
+
+		m_tick = static_cast<std::uint32_t>(header.tick);
+		std::apply([this](auto& ... pools) { (pools.set_tick(m_tick), ...); }, m_component_pools);
+
+		bool pools_loaded = std::apply([&in](auto& ... pools) { return (pools.load(in) && ...); }, m_component_pools);
+		if (!pools_loaded)
+		{
+			return false;
+		}
+
+		m_next_index.store(header.entities, std::memory_order_release);
+		m_free_head.store(header.free_head, std::memory_order_release);
+
+		/// Prefabs are the entities with components that are in no bucket
+		for (size_t i = 0; i < header.entities; ++i)
+		{
+			entity_record& record = m_entity_records[i];
+			record.prefab = record.signature.any() && record.location.bucket == m_invalid_bucket;
+		}
+
+		/// Observers learn about the loaded entities at the next flush
+		for (const signature_bucket& bucket : m_buckets)
+		{
+			for (entity_id e_id : bucket.entities)
+			{
+				record_events(e_id, bucket.signature, true);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Takes a snapshot of the registry. Pool occupancy and bucket sizes are always reported;
+	 *		  counters and query timings need REFLECS_INSTRUMENTATION and cover the time since
+	 *		  the last reset_stats(). Must not be called while iterating or flushing.
+	*/
+	reflecs::instrumentation::registry_stats stats()
+	{
+		reflecs::instrumentation::registry_stats snapshot;
+
+		snapshot.buckets = m_buckets.size();
+		for (const signature_bucket& bucket : m_buckets)
+		{
+			size_t size = bucket.entities.size();
+			if (size == 0)
+			{
+				snapshot.empty_buckets++;
+				continue;
+			}
+			snapshot.entities += size;
+
+			size_t bin = 0;
+			while (size >> (bin + 1))
+			{
+				bin++;
+			}
+			if (bin >= snapshot.bucket_histogram.size())
+			{
+				snapshot.bucket_histogram.resize(bin + 1);
+			}
+			snapshot.bucket_histogram[bin]++;
+		}
+
+		(snapshot.pools.push_back(describe_pool<Cs>()), ...);
+
+		if constexpr (reflecs::instrumentation::enabled)
+		{
+			auto totals = m_stats.totals();
+			for (size_t i = 0; i < m_registered_components; ++i)
+			{
+				snapshot.pools[i].adds = totals.adds[i];
+				snapshot.pools[i].removes = totals.removes[i];
+			}
+			snapshot.created = totals.created;
+			snapshot.destroyed = totals.destroyed;
+			snapshot.migrations = totals.migrations;
+
+			std::lock_guard<std::mutex> lock(query_signatures_mutex());
+			for (size_t slot = 0; slot < query_signatures().size(); ++slot)
+			{
+				if (totals.query_calls[slot] > 0)
+				{
+					snapshot.queries.push_back({ describe_query(query_signatures()[slot]), totals.query_calls[slot], totals.query_entities[slot], totals.query_nanoseconds[slot] });
+				}
+			}
+		}
+		return snapshot;
+	}
+
+	/// Starts a new measuring period for the counters reported by stats(), e.g. once per tick
+	void reset_stats()
+	{
+		m_stats.reset();
+	}
+
+private:
+	/**
+	 * @brief Updates the calling thread's counters; compiles to nothing without instrumentation
+	 * @param update Invoked with the thread's counters
+	*/
+	template<typename F>
+	void record_stats(F&& update)
+	{
+		if constexpr (reflecs::instrumentation::enabled)
+		{
+			update(m_stats.local());
+		}
+	}
+
+	/**
+	 * @brief Writes the sections of a snapshot
+	 * @param out Snapshot writer
+	 * @param checkpoint Leave the pages of file-backed pools in their files
+	*/
+	void write_snapshot(reflecs::snapshot::writer& out, bool checkpoint) const
+	{
+		reflecs::snapshot::header header;
+		header.components = m_registered_components;
+		header.entities = m_next_index.load(std::memory_order_acquire);
+		header.free_head = m_free_head.load(std::memory_order_acquire);
+		header.tick = m_tick;
+		out.write_value(header);
+
+		/// Entity records as three columns
+		std::vector<std::uint32_t> generations(header.entities);
+		std::vector<std::uint32_t> next_free(header.entities);
+		for (size_t i = 0; i < header.entities; ++i)
+		{
+			generations[i] = m_entity_records[i].generation.load(std::memory_order_relaxed);
+			next_free[i] = m_entity_records[i].next_free.load(std::memory_order_relaxed);
+		}
+		out.write(generations.data(), generations.size() * sizeof(std::uint32_t));
+		out.write(next_free.data(), next_free.size() * sizeof(std::uint32_t));
+		for (size_t i = 0; i < header.entities; ++i)
+		{
+			reflecs::snapshot::write_bits(out, m_entity_records[i].signature);
+		}
+
+		/// Signature table; bucket positions are restored from the entity order
+		out.write_value(std::uint64_t(m_buckets.size()));
+		for (const signature_bucket& bucket : m_buckets)
+		{
+			reflecs::snapshot::write_bits(out, bucket.signature);
+			out.write_value(std::uint64_t(bucket.entities.size()));
+			out.write(bucket.entities.data(), bucket.entities.size() * sizeof(entity_id));
+		}
+
+		std::apply([&out, checkpoint](const auto& ... pools) { (pools.save(out, checkpoint), ...); }, m_component_pools);
+	}
+
+	/**
+	 * @brief Starts timing a query over the given components; the timer records when it goes out of scope
+	 * @tparam ...Ts Components
+	*/
+	template<typename ... Ts>
+	reflecs::instrumentation::query_timer<m_registered_components> time_query()
+	{
+		if constexpr (reflecs::instrumentation::enabled)
+		{
+			static const size_t slot = register_query(create_filter<Ts...>());
+			return { m_stats, slot };
+		}
+		else
+		{
+			return { m_stats, 0 };
+		}
+	}
+
+	/// Filters of the timed queries, indexed by their counter slot; shared by every registry of this type
+	static std::vector<signature_filter>& query_signatures()
+	{
+		static std::vector<signature_filter> signatures;
+		return signatures;
+	}
+
+	static std::mutex& query_signatures_mutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	/**
+	 * @brief Assigns a counter slot to a query filter; queries with the same terms share a slot
+	 * @param filter Terms of the query
+	 * @return The slot; g_max_queries once every slot is taken
+	*/
+	static size_t register_query(const signature_filter& filter)
+	{
+		std::lock_guard<std::mutex> lock(query_signatures_mutex());
+		for (size_t slot = 0; slot < query_signatures().size(); ++slot)
+		{
+			const signature_filter& known = query_signatures()[slot];
+			if (known.required == filter.required && known.excluded == filter.excluded && known.any_of == filter.any_of)
+			{
+				return slot;
+			}
+		}
+
+		if (query_signatures().size() == reflecs::instrumentation::g_max_queries)
+		{
+			return reflecs::instrumentation::g_max_queries;
+		}
+		query_signatures().push_back(filter);
+		return query_signatures().size() - 1;
+	}
+
+	/**
+	 * @brief Label of a timed query: the required components, followed by the excluded ones and
+	 *		  every any_of group, each as one character per registered component, last component first
+	 * @param filter Terms of the query
+	*/
+	static std::string describe_query(const signature_filter& filter)
+	{
+		std::string label = filter.required.to_string();
+		if (filter.excluded.any())
+		{
+			label += " without " + filter.excluded.to_string();
+		}
+		for (const bit_mask& group : filter.any_of)
+		{
+			label += " any_of " + group.to_string();
+		}
+		return label;
+	}
+
+	/// Hands out a distinct id to every registry ever created
+	static size_t next_uid()
+	{
+		static std::atomic<size_t> uid = 0;
+		return uid.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Changes a single component of an entity: updates the pool under its lock, then the
+	 *		  entity's signature and bucket. The entity's lock is held throughout, so changes
+	 *		  of the same entity from several threads are applied one after the other.
+	 * @tparam C Component
+	 * @param e_id Entity's ID
+	 * @param add Whether the component is added or removed
+	 * @param update_pool Invoked as update_pool(pool, slot index); not invoked for tags
+	 * @return False if the entity is invalid or was destroyed
+	*/
+	template<typename C, typename F>
+	bool change_component(entity_id e_id, bool add, F&& update_pool)
+	{
+		constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+
+		size_t e_index = reflecs::entity_utils::index_of(e_id);
+		std::lock_guard<reflecs::concurrency::mutex> entity_lock(m_entity_locks[e_index % reflecs::concurrency::g_lock_stripes]);
+		if (!valid(e_id))
+		{
+			return false;
+		}
+
+		if constexpr (reflecs::component_reflection::is_tag<C>::value)
+		{
+			assert((add || m_entity_records[e_index].signature[component_id]) && "Entity does not have the tag");
+		}
+		else
+		{
+			std::lock_guard<reflecs::concurrency::mutex> pool_lock(m_pool_locks[component_id]);
+			update_pool(retrieve_pool<C>(), e_index);
+		}
+
+		update_mask<C>(e_id, add);
+		return true;
+	}
+
+	/**
+	 * @brief Adds a component to a batch of entities one entity at a time, so every entity
+	 *		  holds its own lock instead of the batch locking them all
+	 * @tparam C Component
+	 * @param e_ids Entities' IDs
+	 * @param count Number of entities
+	 * @param update_pool Invoked as update_pool(pool, pointer to the slot index, position in the batch)
+	*/
+	template<typename C, typename F>
+	void add_one_by_one(const entity_id* e_ids, size_t count, F&& update_pool)
+	{
+		size_t added = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			bool valid_id = change_component<C>(e_ids[i], true, [&update_pool, i](auto& pool, size_t e_index)
+				{
+					entity_id index = e_index;
+					update_pool(pool, &index, i);
+				}
+			);
+			assert(valid_id && "Entity id is invalid or was destroyed");
+			added += valid_id;
+		}
+		record_stats([added](auto& counters) { counters.adds[reflecs::type_utils::get_component_type_id<C, Cs...>()].add(added); });
+	}
+
+	/**
+	 * @brief Moves a batch of constructed components into the pool, without touching the signatures
+	 * @tparam C Component
+	 * @param indices Entities' slot indices
+	 * @param count Number of entities
+	 * @param components count components; ignored for tags
+	*/
+	template<typename C>
+	void add_components(const entity_id* indices, size_t count, const C* components)
+	{
+		if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+		{
+			retrieve_pool<C>().add_components(indices, count, components);
+		}
+	}
+
+	/**
+	 * @brief Adds several components to an entity while holding its lock, each pool under its
+	 *		  own lock, then moves the entity to its new bucket once
+	 * @tparam ...Ts Components
+	 * @param e_id Entity's ID
+	 * @param i Position of the entity in the batch
+	 * @param components One array per component; ignored for tags
+	 * @return False if the entity is invalid or was destroyed
+	*/
+	template<typename ... Ts>
+	bool add_under_lock(entity_id e_id, size_t i, const Ts* ... components)
+	{
+		size_t e_index = reflecs::entity_utils::index_of(e_id);
+		std::lock_guard<reflecs::concurrency::mutex> entity_lock(m_entity_locks[e_index % reflecs::concurrency::g_lock_stripes]);
+		if (!valid(e_id))
+		{
+			return false;
+		}
+
+		entity_id index = e_index;
+		(add_component_locked<Ts>(index, components, i), ...);
+
+		gain_components<Ts...>(m_entity_records[e_index], e_id);
+		migrate(e_id);
+		return true;
+	}
+
+	/**
+	 * @brief Adds one component of a batch to an entity under the pool's lock
+	 * @tparam C Component
+	 * @param index Entity's slot index
+	 * @param components Batch of components; ignored for tags
+	 * @param i Position of the entity in the batch
+	*/
+	template<typename C>
+	void add_component_locked(entity_id index, const C* components, size_t i)
+	{
+		if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+		{
+			constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+			std::lock_guard<reflecs::concurrency::mutex> pool_lock(m_pool_locks[component_id]);
+			retrieve_pool<C>().add_components(&index, 1, components + i);
+		}
+	}
+
+	/**
+	 * @brief Sets the components' bits in an entity's signature without migrating it
+	 * @tparam ...Ts Components
+	 * @param record Entity's record
+	 * @param e_id Entity's ID
+	*/
+	template<typename ... Ts>
+	void gain_components(entity_record& record, entity_id e_id)
+	{
+		constexpr size_t component_ids[] = { reflecs::type_utils::get_component_type_id<Ts, Cs...>()... };
+		for (size_t component_id : component_ids)
+		{
+			if (!record.signature[component_id])
+			{
+				record_event(component_id, e_id, true);
+			}
+			record.signature.set(component_id);
+		}
+	}
+
+	/**
+	 * @brief Changes a bit of the entity's signature without migrating it; the entity is queued
+	 *		  for migration the first time its signature leaves its bucket's signature
+	 * @param record Entity's record
+	 * @param e_id Entity's ID
+	 * @param component_id Component's ID
+	 * @param add Set or unset the bit
+	 * @param touched Entities waiting for their migration
+	*/
+	void defer_mask_update(entity_record& record, entity_id e_id, size_t component_id, bool add, std::vector<entity_id>& touched)
+	{
+		size_t bucket = record.location.bucket == m_invalid_bucket ? 0 : record.location.bucket;
+		if (record.signature == m_buckets[bucket].signature)
+		{
+			touched.push_back(e_id);
+		}
+		if (record.signature[component_id] != add)
+		{
+			record_event(component_id, e_id, add);
+		}
+		record.signature.set(component_id, add);
+	}
+
+	/**
+	 * @brief Queues a membership change for the component's observers, if it has any; prefabs are not observed
+	 * @param component_id Component's ID
+	 * @param e_id Entity's ID
+	 * @param added Whether the entity gained or lost the component
+	*/
+	void record_event(size_t component_id, entity_id e_id, bool added)
+	{
+		if (!m_observed[component_id] || m_entity_records[reflecs::entity_utils::index_of(e_id)].prefab)
+		{
+			return;
+		}
+
+		component_observers& observers = m_observers[component_id];
+		std::lock_guard<reflecs::concurrency::mutex> lock(observers.mutex);
+		observers.events.emplace_back(e_id, added);
+	}
+
+	/**
+	 * @brief Queues a membership change of every observed component in the signature
+	 * @param e_id Entity's ID
+	 * @param signature Components that were gained or lost
+	 * @param added Whether the entity gained or lost them
+	*/
+	void record_events(entity_id e_id, const bit_mask& signature, bool added)
+	{
+		bit_mask observed = signature & m_observed;
+		for (size_t component_id = 0; observed.any(); ++component_id)
+		{
+			if (observed[component_id])
+			{
+				record_event(component_id, e_id, added);
+				observed.reset(component_id);
+			}
+		}
+	}
+
+	/**
+	 * @brief Reduces the queued changes of a component to one net change per entity and
+	 *		  hands them to the observers, removals first
+	 * @param observers Observers of the component
+	*/
+	void deliver_events(component_observers& observers)
+	{
+		if (observers.events.empty())
+		{
+			return;
+		}
+
+		std::vector<std::pair<entity_id, bool>>& events = observers.delivering;
+		events.swap(observers.events);
+		observers.added.clear();
+		observers.removed.clear();
+
+		/// Grouping by entity keeps the order of each entity's changes; only the first and the last one matter
+		std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		for (size_t first = 0; first < events.size();)
+		{
+			size_t last = first;
+			while (last + 1 < events.size() && events[last + 1].first == events[first].first)
+			{
+				last++;
+			}
+
+			/// Gaining after lacking the component, or losing after having it, is a net change
+			if (events[first].second == events[last].second)
+			{
+				(events[first].second ? observers.added : observers.removed).push_back(events[first].first);
+			}
+			first = last + 1;
+		}
+		events.clear();
+
+		if (!observers.removed.empty())
+		{
+			for (observer& function : observers.on_remove)
+			{
+				function(observers.removed.data(), observers.removed.size());
+			}
+		}
+		if (!observers.added.empty())
+		{
+			for (observer& function : observers.on_add)
+			{
+				function(observers.added.data(), observers.added.size());
+			}
+		}
+	}
+
+	/**
+	 * @brief Replays the recorded adds and removes of a component in the order they were recorded,
+	 *		  so the last command for an entity decides whether it keeps the component
+	 * @tparam index Component's ID
+	 * @param buffer Command buffer
+	 * @param touched Entities waiting for their migration
+	*/
+	template<size_t index>
+	void flush_commands(command_buffer<Cs...>& buffer, std::vector<entity_id>& touched)
+	{
+		auto& adds = std::get<index>(buffer.m_adds);
+		auto& removes = buffer.m_removes[index];
+
+		size_t next_add = 0;
+		size_t next_remove = 0;
+		while (next_add < adds.size() || next_remove < removes.size())
+		{
+			if (next_remove == removes.size() || (next_add < adds.size() && adds[next_add].sequence < removes[next_remove].second))
+			{
+				flush_add<index>(adds[next_add].e_id, adds[next_add].component, touched);
+				next_add++;
+			}
+			else
+			{
+				flush_remove<index>(removes[next_remove].first, touched);
+				next_remove++;
+			}
+		}
+	}
+
+	/**
+	 * @brief Dummy class with a defined functor to invoke flush_commands()
+	 * @tparam index Component's ID
+	*/
+	template<size_t index>
+	struct flush_commands_wrapper
+	{
+		void operator()(registry* parent, command_buffer<Cs...>& buffer, std::vector<entity_id>& touched)
+		{
+			parent->flush_commands<index>(buffer, touched);
+		}
+	};
+
+	/**
+	 * @brief Applies a recorded add; the entity's migration is deferred
+	 * @tparam index Component's ID
+	 * @param e_id Entity's ID
+	 * @param component Component to move into the pool
+	 * @param touched Entities waiting for their migration
+	*/
+	template<size_t index, typename C>
+	void flush_add(entity_id e_id, C& component, std::vector<entity_id>& touched)
+	{
+		if (!valid(e_id))
+		{
+			return;
+		}
+
+		size_t e_index = reflecs::entity_utils::index_of(e_id);
+		if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+		{
+			retrieve_pool<C>().add(e_index, std::move(component));
+		}
+		record_stats([](auto& counters) { counters.adds[index].add(1); });
+		defer_mask_update(m_entity_records[e_index], e_id, index, true, touched);
+	}
+
+	/**
+	 * @brief Applies a recorded remove; the entity's migration is deferred
+	 * @tparam index Component's ID
+	 * @param e_id Entity's ID
+	 * @param touched Entities waiting for their migration
+	*/
+	template<size_t index>
+	void flush_remove(entity_id e_id, std::vector<entity_id>& touched)
+	{
+		using C = reflecs::type_utils::component_type_at_index<index, Cs...>;
+
+		if (!valid(e_id))
+		{
+			return;
+		}
+
+		size_t e_index = reflecs::entity_utils::index_of(e_id);
+		entity_record& record = m_entity_records[e_index];
+		if (!record.signature[index])
+		{
+			return;
+		}
+
+		if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+		{
+			retrieve_pool<C>().remove(e_index);
+		}
+		record_stats([](auto& counters) { counters.removes[index].add(1); });
+		defer_mask_update(record, e_id, index, false, touched);
+	}
+
+	/**
+	 * @brief Removes/Adds component's ID to entity's component bit mask
+	 *		  and moves the entity to the bucket of its new signature
+	 * @tparam C Component
+	 * @param e_id Entity's ID
+	 * @param add Set or unset the bit
+	*/
+	template<typename C>
+	void update_mask(entity_id e_id, bool add)
+	{
+		constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+
+		entity_record& record = m_entity_records[reflecs::entity_utils::index_of(e_id)];
+		if (record.signature[component_id] != add)
+		{
+			record_event(component_id, e_id, add);
+		}
+		record.signature.set(component_id, add);
+
+		migrate(e_id);
+	}
+
+	/**
+	 * @brief Sets the components' bits for a batch of entities and moves them to their new buckets.
+	 *		  Entities leaving the same bucket share one transition lookup, and the target bucket
+	 *		  grows once for the whole batch.
+	 * @tparam ...Ts Components
+	 * @param e_ids Entities' IDs
+	 * @param count Number of entities
+	*/
+	template<typename ... Ts>
+	void update_mask_batch(const entity_id* e_ids, size_t count)
+	{
+		size_t cached_source = m_invalid_bucket;
+		size_t cached_target = m_invalid_bucket;
+		for (size_t i = 0; i < count; ++i)
+		{
+			entity_record& record = m_entity_records[reflecs::entity_utils::index_of(e_ids[i])];
+			gain_components<Ts...>(record, e_ids[i]);
+			if (record.prefab)
+			{
+				continue;
+			}
+
+			size_t source = record.location.bucket == m_invalid_bucket ? 0 : record.location.bucket;
+			if (source != cached_source)
+			{
+				cached_source = source;
+				cached_target = find_bucket(source, record.signature);
+
+				std::vector<entity_id>& entities = m_buckets[cached_target].entities;
+				entities.reserve(entities.size() + count - i);
+			}
+
+			if (cached_target != source)
+			{
+				if (source != 0)
+				{
+					detach(e_ids[i]);
+				}
+				attach(e_ids[i], cached_target);
+				record_stats([](auto& counters) { counters.migrations.add(1); });
+			}
+		}
+	}
+
+	/**
+	 * @brief Converts entity ids to slot indices
+	 * @param e_ids Entities' IDs
+	 * @param count Number of entities
+	 * @param indices Receives the slot indices
+	 * @return False if any of the ids is invalid
+	*/
+	bool collect_indices(const entity_id* e_ids, size_t count, std::vector<entity_id>& indices)
+	{
+		indices.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!valid(e_ids[i]))
+			{
+				assert(false && "Entity id is invalid or was destroyed");
+				return false;
+			}
+			indices[i] = reflecs::entity_utils::index_of(e_ids[i]);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Copies the template's component to the clones, if the template has it
+	 * @tparam index Component's ID
+	 * @param prefab_index Template entity's slot
+	 * @param signature Template's signature
+	 * @param indices Slots of the clones
+	*/
+	template<size_t index>
+	void copy_component(size_t prefab_index, const bit_mask& signature, const std::vector<entity_id>& indices)
+	{
+		using C = reflecs::type_utils::component_type_at_index<index, Cs...>;
+
+		if (!signature[index] || indices.empty())
+		{
+			return;
+		}
+		if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+		{
+			std::lock_guard<reflecs::concurrency::mutex> pool_lock(m_pool_locks[index]);
+			component_manager<C>& pool = retrieve_pool<C>();
+			pool.add_copies(indices.data(), indices.size(), pool.look_up(prefab_index));
+		}
+		record_stats([&indices](auto& counters) { counters.adds[index].add(indices.size()); });
+	}
+
+	/**
+	 * @brief Dummy class with a defined functor to invoke copy_component()
+	 * @tparam index Component's ID
+	*/
+	template<size_t index>
+	struct copy_component_wrapper
+	{
+		void operator()(registry* parent, size_t prefab_index, const bit_mask& signature, const std::vector<entity_id>& indices)
+		{
+			parent->copy_component<index>(prefab_index, signature, indices);
+		}
+	};
+
+	/**
+	 * @brief Moves the entity to the bucket matching the signature stored in its record
+	 * @param e_id Entity's ID
+	*/
+	void migrate(entity_id e_id)
+	{
+		entity_record& record = m_entity_records[reflecs::entity_utils::index_of(e_id)];
+		if (record.prefab)
+		{
+			return;
+		}
+
+		/// Entities without components are not stored in a bucket, but take their transitions from the empty one
+		size_t source = record.location.bucket == m_invalid_bucket ? 0 : record.location.bucket;
+		size_t target = find_bucket(source, record.signature);
+
+		if (target != source)
+		{
+			if (source != 0)
+			{
+				detach(e_id);
+			}
+			if (target != 0)
+			{
+				attach(e_id, target);
+			}
+			record_stats([](auto& counters) { counters.migrations.add(1); });
+		}
+	}
+
+	/**
+	 * @brief Finds the bucket of a signature. Cached transitions are followed under the shared
+	 *		  table lock; only a missing transition takes the table lock exclusively.
+	 * @param source Index of the bucket to start from
+	 * @param signature Signature of the bucket to find
+	 * @return Index of the bucket
+	*/
+	size_t find_bucket(size_t source, const bit_mask& signature)
+	{
+		{
+			std::shared_lock<reflecs::concurrency::shared_mutex> table_lock(m_buckets_lock);
+			size_t target = resolve_bucket(source, signature, !reflecs::concurrency::enabled);
+			if (target != m_invalid_bucket)
+			{
+				return target;
+			}
+		}
+
+		std::lock_guard<reflecs::concurrency::shared_mutex> table_lock(m_buckets_lock);
+		return resolve_bucket(source, signature);
+	}
+
+	/**
+	 * @brief Finds the bucket of a signature by following the cached transitions from another bucket,
+	 *		  one per differing component. Transitions taken for the first time are resolved
+	 *		  once through the signature map.
+	 * @param source Index of the bucket to start from
+	 * @param signature Signature of the bucket to find
+	 * @param create Whether missing transitions are resolved; if not, m_invalid_bucket is returned for them
+	 * @return Index of the bucket
+	*/
+	size_t resolve_bucket(size_t source, const bit_mask& signature, bool create = true)
+	{
+		size_t current = source;
+		bit_mask difference = m_buckets[source].signature ^ signature;
+
+		for (size_t component_id = 0; difference.any(); ++component_id)
+		{
+			if (!difference[component_id])
+			{
+				continue;
+			}
+			difference.reset(component_id);
+
+			bool add = signature[component_id];
+			size_t next = add ? m_buckets[current].add_edges[component_id] : m_buckets[current].remove_edges[component_id];
+			if (next == m_invalid_bucket)
+			{
+				if (!create)
+				{
+					return m_invalid_bucket;
+				}
+
+				bit_mask s = m_buckets[current].signature;
+				s.set(component_id, add);
+				next = find_or_create_bucket(s);
+
+				if (add)
+				{
+					m_buckets[current].add_edges[component_id] = next;
+				}
+				else
+				{
+					m_buckets[current].remove_edges[component_id] = next;
+				}
+			}
+			current = next;
+		}
+		return current;
+	}
+
+	/**
+	 * @brief Invokes the function for every entity in the bucket
+	 * @tparam ...Ts Components
+	 * @param bucket Signature bucket
+	 * @param function Function object (lambda/functor)
+	*/
+	template<typename ... Ts, typename F>
+	void visit_bucket(signature_bucket& bucket, F& function)
+	{
+		for (auto entity_id : bucket.entities)
+		{
+			invoke_terms<Ts...>(function, entity_id);
+		}
+	}
+
+	/**
+	 * @brief Invokes the chunk function for every contiguous run of instances in the bucket
+	 * @tparam ...Ts Components
+	 * @param bucket Signature bucket
+	 * @param function Function object (lambda/functor)
+	*/
+	template<typename ... Ts, typename F>
+	void visit_bucket_chunks(signature_bucket& bucket, F& function, reflecs::type_utils::type_list<Ts...>)
+	{
+		static_assert(!(reflecs::filters::is_optional<Ts>::value || ...), "Chunks need every component; use for_each for optional components");
+
+		visit_bucket_runs<Ts...>(bucket, [this, &function](const entity_id*, const std::array<component_instance, sizeof...(Ts)>& first_instances, size_t count)
+			{
+				invoke_chunk<Ts...>(function, first_instances, count, std::index_sequence_for<Ts...>());
+			}
+		);
+	}
+
+	/**
+	 * @brief Invokes the function for every entity in the bucket with views that share
+	 *		  the field base pointers of each contiguous run
+	 * @tparam ...Ts Components, optionally const
+	 * @param bucket Signature bucket
+	 * @param function Function object (lambda/functor)
+	*/
+	template<typename ... Ts, typename F>
+	void visit_bucket_views(signature_bucket& bucket, F& function, reflecs::type_utils::type_list<Ts...>)
+	{
+		static_assert(!(reflecs::filters::is_optional<std::remove_const_t<Ts>>::value || ...), "Views need every component; use for_each for optional components");
+
+		visit_bucket_runs<std::remove_const_t<Ts>...>(bucket, [this, &function](const entity_id* entities, const std::array<component_instance, sizeof...(Ts)>& first_instances, size_t count)
+			{
+				invoke_views<Ts...>(function, entities, first_instances, count, std::index_sequence_for<Ts...>());
+			}
+		);
+	}
+
+	/**
+	 * @brief Splits the bucket into runs of entities whose instances are consecutive within a block in every pool
+	 * @tparam ...Ts Components
+	 * @param bucket Signature bucket
+	 * @param visit Invoked as visit(first entity, first instances, count) for every run
+	*/
+	template<typename ... Ts, typename F>
+	void visit_bucket_runs(signature_bucket& bucket, F&& visit)
+	{
+		const std::vector<entity_id>& entity_vec = bucket.entities;
+		size_t begin = 0;
+		while (begin < entity_vec.size())
+		{
+			std::array<component_instance, sizeof...(Ts)> first_instances = { retrieve_pool<Ts>().look_up(reflecs::entity_utils::index_of(entity_vec[begin]))... };
+
+			/// Grow the chunk while every pool keeps handing out the next instance within the same block
+			size_t limit = std::min(entity_vec.size() - begin, contiguous_instances<Ts...>(first_instances, std::index_sequence_for<Ts...>()));
+			size_t count = 1;
+			while (count < limit && instances_follow<Ts...>(entity_vec[begin + count], first_instances, count, std::index_sequence_for<Ts...>()))
+			{
+				count++;
+			}
+
+			visit(entity_vec.data() + begin, first_instances, count);
+			begin += count;
+		}
+	}
+
+	/**
+	 * @brief Splits the bucket into ranges of at most grain_size entities
+	 * @param bucket Signature bucket
+	 * @param grain_size Maximum number of entities per range
+	 * @param chunks Receives the ranges
+	*/
+	void split_bucket(signature_bucket& bucket, size_t grain_size, std::vector<entity_range>& chunks)
+	{
+		grain_size = std::max<size_t>(1, grain_size);
+
+		const std::vector<entity_id>& entity_vec = bucket.entities;
+		for (size_t begin = 0; begin < entity_vec.size(); begin += grain_size)
+		{
+			chunks.emplace_back(entity_vec.data() + begin, std::min(grain_size, entity_vec.size() - begin));
+		}
+	}
+
+	/**
+	 * @brief Processes the ranges on the thread pool
+	 * @tparam ...Ts Components
+	 * @param pool Thread pool executing the ranges
+	 * @param chunks Entity ranges
+	 * @param function Function object (lambda/functor)
+	*/
+	template<typename ... Ts, typename F>
+	void run_parallel(thread_pool& pool, const std::vector<entity_range>& chunks, F& function)
+	{
+		pool.parallel_for(chunks.size(), 1, [this, &chunks, &function](size_t begin, size_t end)
+			{
+				for (size_t chunk = begin; chunk < end; ++chunk)
+				{
+					auto [entities, count] = chunks[chunk];
+					for (size_t i = 0; i < count; ++i)
+					{
+						invoke_terms<Ts...>(function, entities[i]);
+					}
+				}
+			}
+		);
+	}
+
+	/**
+	 * @brief Instance of C held by the entity's parent
+	 * @tparam C Component
+	 * @param e_index Entity slot
+	 * @return 0 if the entity is a root for C
+	*/
+	template<typename C>
+	component_instance parent_instance_of(size_t e_index)
+	{
+		component_manager<parent_link>& links = retrieve_pool<parent_link>();
+		component_instance link = links.look_up(e_index);
+		if (link == 0)
+		{
+			return 0;
+		}
+
+		entity_id parent = links.template get_member_value<0>(link);
+		if (!valid(parent) || m_entity_records[reflecs::entity_utils::index_of(parent)].prefab)
+		{
+			return 0;
+		}
+		return retrieve_pool<C>().look_up(reflecs::entity_utils::index_of(parent));
+	}
+
+	/**
+	 * @brief Slots of the entities with C in breadth-first order: roots keep their current order,
+	 *		  and every deeper level lists the children of earlier parents first. Prefabs are left
+	 *		  out, so sorting moves their instances behind the hierarchy.
+	 * @tparam C Component
+	*/
+	template<typename C>
+	std::vector<size_t> depth_order()
+	{
+		constexpr std::uint32_t unknown = -1;
+		constexpr std::uint32_t visiting = -2;
+		constexpr std::uint32_t excluded = -3;
+
+		component_manager<C>& pool = retrieve_pool<C>();
+		size_t count = pool.size();
+		std::vector<component_instance> parents(count + 1, 0);
+		std::vector<std::uint32_t> depths(count + 1, unknown);
+		for (component_instance instance = 1; instance <= count; ++instance)
+		{
+			size_t e_index = pool.owner_of(instance);
+			if (m_entity_records[e_index].prefab)
+			{
+				depths[instance] = excluded;
+				continue;
+			}
+			parents[instance] = parent_instance_of<C>(e_index);
+		}
+
+		/// Climb to the first ancestor with a known depth, then assign the depths on the way back down
+		std::vector<component_instance> path;
+		size_t levels = 1;
+		for (component_instance instance = 1; instance <= count; ++instance)
+		{
+			component_instance current = instance;
+			while (current != 0 && depths[current] == unknown)
+			{
+				depths[current] = visiting;
+				path.push_back(current);
+				current = parents[current];
+			}
+			if (current != 0 && depths[current] == visiting)
+			{
+				assert(false && "Parent links form a cycle");
+				parents[path.back()] = 0;
+			}
+
+			for (auto it = path.rbegin(); it != path.rend(); ++it)
+			{
+				component_instance parent = parents[*it];
+				depths[*it] = parent == 0 ? 0 : depths[parent] + 1;
+				levels = std::max<size_t>(levels, depths[*it] + 1);
+			}
+			path.clear();
+		}
+
+		/// Counting sort by depth keeps the current order within a level
+		std::vector<size_t> level_begins(levels + 1, 0);
+		for (component_instance instance = 1; instance <= count; ++instance)
+		{
+			if (depths[instance] != excluded)
+			{
+				level_begins[depths[instance] + 1]++;
+			}
+		}
+		for (size_t level = 1; level <= levels; ++level)
+		{
+			level_begins[level] += level_begins[level - 1];
+		}
+
+		std::vector<component_instance> sorted(level_begins[levels]);
+		std::vector<size_t> next = level_begins;
+		for (component_instance instance = 1; instance <= count; ++instance)
+		{
+			if (depths[instance] != excluded)
+			{
+				sorted[next[depths[instance]]++] = instance;
+			}
+		}
+
+		/// Order every level by the new position of the parents
+		std::vector<size_t> positions(count + 1, 0);
+		for (size_t level = 0; level < levels; ++level)
+		{
+			auto begin = sorted.begin() + level_begins[level];
+			auto end = sorted.begin() + level_begins[level + 1];
+			if (level > 0)
+			{
+				std::stable_sort(begin, end, [&](component_instance a, component_instance b) { return positions[parents[a]] < positions[parents[b]]; });
+			}
+			for (auto it = begin; it != end; ++it)
+			{
+				positions[*it] = it - sorted.begin();
+			}
+		}
+
+		std::vector<size_t> order(sorted.size());
+		for (size_t i = 0; i < sorted.size(); ++i)
+		{
+			order[i] = pool.owner_of(sorted[i]);
+		}
+		return order;
+	}
+
+	/**
+	 * @brief Moves the instances of C, parent_link and the components Ts into C's depth order,
+	 *		  unless none of the pools changed since they were last sorted for this traversal
+	 * @tparam C Component defining the order
+	 * @tparam ...Ts Query terms whose components follow the order
+	*/
+	template<typename C, typename ... Ts>
+	void sort_by_depth(reflecs::type_utils::type_list<Ts...>)
+	{
+		static_assert(reflecs::type_utils::get_component_type_id<parent_link, Cs...>() != size_t(-1), "Register parent_link to use hierarchies");
+
+		std::uint64_t& sorted = m_depth_orders[std::type_index(typeid(reflecs::type_utils::type_list<C, Ts...>))];
+		if (sorted == depth_order_revision<C, parent_link, Ts...>())
+		{
+			return;
+		}
+
+		std::vector<size_t> order = depth_order<C>();
+		sort_pool<C>(order);
+		sort_pool<parent_link>(order);
+		(sort_pool<Ts>(order), ...);
+		sorted = depth_order_revision<C, parent_link, Ts...>();
+	}
+
+	/// Sum of the revisions of the pools of the terms; changes whenever one of them does
+	template<typename ... Ts>
+	std::uint64_t depth_order_revision()
+	{
+		return (pool_revision<Ts>() + ...);
+	}
+
+	template<typename T>
+	std::uint64_t pool_revision()
+	{
+		if constexpr (reflecs::filters::is_optional<T>::value)
+		{
+			return pool_revision<typename T::component>();
+		}
+		else if constexpr (reflecs::component_reflection::is_tag<T>::value)
+		{
+			return 0;
+		}
+		else
+		{
+			return retrieve_pool<T>().revision();
+		}
+	}
+
+	/**
+	 * @brief Moves the instances of the term's component into the order of the entities holding it
+	 * @tparam T Component or filters::optional term
+	 * @param order Entity slots
+	*/
+	template<typename T>
+	void sort_pool(const std::vector<size_t>& order)
+	{
+		if constexpr (reflecs::filters::is_optional<T>::value)
+		{
+			sort_pool<typename T::component>(order);
+		}
+		else if constexpr (!reflecs::component_reflection::is_tag<T>::value)
+		{
+			component_manager<T>& pool = retrieve_pool<T>();
+			std::vector<size_t> holders;
+			holders.reserve(pool.size());
+			for (size_t e_index : order)
+			{
+				if (pool.look_up(e_index) != 0)
+				{
+					holders.push_back(e_index);
+				}
+			}
+			pool.sort_instances(holders);
+		}
+	}
+
+	/**
+	 * @brief Pops a slot from the free list
+	 * @param index Receives the slot index
+	 * @return Whether the free list held a slot
+	*/
+	bool pop_free_slot(size_t& index)
+	{
+		std::uint64_t head = m_free_head.load(std::memory_order_acquire);
+		while (true)
+		{
+			std::uint32_t slot = static_cast<std::uint32_t>(head);
+			if (slot == m_free_list_end)
+			{
+				return false;
+			}
+
+			/// The tag changes on every exchange, so a slot popped and pushed back in between fails the exchange
+			std::uint32_t next = m_entity_records[slot].next_free.load(std::memory_order_relaxed);
+			std::uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+			if (m_free_head.compare_exchange_weak(head, new_head, std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				index = slot;
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * @brief Pushes a slot onto the free list
+	 * @param index Slot index
+	*/
+	void push_free_slot(size_t index)
+	{
+		entity_record& record = m_entity_records[index];
+
+		std::uint64_t head = m_free_head.load(std::memory_order_relaxed);
+		std::uint64_t new_head;
+		do
+		{
+			record.next_free.store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+			new_head = (((head >> 32) + 1) << 32) | index;
+		} while (!m_free_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/**
+	 * @brief Returns the bucket of a signature, creating it on first use
+	 * @param signature Component signature
+	 * @return Index of the bucket
+	*/
+	size_t find_or_create_bucket(const bit_mask& signature)
+	{
+		auto it = m_signatures_to_buckets.find(signature);
+		if (it != m_signatures_to_buckets.end())
+		{
+			return it->second;
+		}
+		return create_bucket(signature);
+	}
+
+	/**
+	 * @brief Creates an empty bucket for a signature
+	 * @param signature Component signature
+	 * @return Index of the bucket
+	*/
+	size_t create_bucket(const bit_mask& signature)
+	{
+		signature_bucket bucket;
+		bucket.signature = signature;
+		bucket.add_edges.fill(m_invalid_bucket);
+		bucket.remove_edges.fill(m_invalid_bucket);
+
+		m_buckets.push_back(std::move(bucket));
+		m_signatures_to_buckets.emplace(signature, m_buckets.size() - 1);
+		return m_buckets.size() - 1;
+	}
+
+	/**
+	 * @brief Appends the entity to a bucket
+	 * @param e_id Entity's ID
+	 * @param bucket Index of the bucket
+	*/
+	void attach(entity_id e_id, size_t bucket)
+	{
+		std::shared_lock<reflecs::concurrency::shared_mutex> table_lock(m_buckets_lock);
+		std::lock_guard<reflecs::concurrency::mutex> bucket_lock(m_bucket_locks[bucket % reflecs::concurrency::g_lock_stripes]);
+
+		std::vector<entity_id>& entities = m_buckets[bucket].entities;
+		m_entity_records[reflecs::entity_utils::index_of(e_id)].location = { bucket, entities.size() };
+		entities.push_back(e_id);
+	}
+
+	/**
+	 * @brief Removes the entity from its bucket by moving the bucket's last entity into its row
+	 * @param e_id Entity's ID
+	*/
+	void detach(entity_id e_id)
+	{
+		bucket_location& location = m_entity_records[reflecs::entity_utils::index_of(e_id)].location;
+
+		std::shared_lock<reflecs::concurrency::shared_mutex> table_lock(m_buckets_lock);
+		std::lock_guard<reflecs::concurrency::mutex> bucket_lock(m_bucket_locks[location.bucket % reflecs::concurrency::g_lock_stripes]);
+
+		std::vector<entity_id>& entities = m_buckets[location.bucket].entities;
+
+		entity_id last = entities.back();
+		entities[location.row] = last;
+		m_entity_records[reflecs::entity_utils::index_of(last)].location.row = location.row;
+		entities.pop_back();
+
+		location = bucket_location();
+	}
+
+	/**
+	* @brief Creates a bit mask for the given set of components
+	*
+	* @tparams ...Cs Components
+	*/
+	template<typename ... Ts>
+	constexpr auto create_signature()
+	{
+		bit_mask signatures;
+
+		(signatures.set(reflecs::type_utils::get_component_type_id<Ts, Cs...>()), ...); // fold expresion since C++ 17; applies same operation for all template aruments 
+		return signatures;
+	}
+
+	/**
+	* @brief Creates a handle for a components to access its fields.
+	* Component handle needs to be partially specialized and defined to work.
+	* Tags have no fields; they are passed as a default constructed tag instead.
+	*
+	* @tparam C Component
+	*/
+	template<typename C>
+	auto create_handle(entity_id e_id)
+	{
+		if constexpr (reflecs::component_reflection::is_tag<C>::value)
+		{
+			return C();
+		}
+		else
+		{
+			return retrieve_pool<C>().retrieve(reflecs::entity_utils::index_of(e_id));
+		}
+	}
+
+	/**
+	* @brief Folds query terms into a signature filter; plain components are required,
+	*		 optional components do not narrow the query
+	*
+	* @tparam ...Ts Components and filters::without, filters::optional or filters::any_of terms
+	*/
+	template<typename ... Ts>
+	signature_filter create_filter()
+	{
+		signature_filter filter;
+		(add_term(filter, static_cast<Ts*>(nullptr)), ...);
+		return filter;
+	}
+
+	template<typename C>
+	void add_term(signature_filter& filter, C*)
+	{
+		filter.required |= create_signature<C>();
+	}
+
+	template<typename ... Xs>
+	void add_term(signature_filter& filter, reflecs::filters::without<Xs...>*)
+	{
+		filter.excluded |= create_signature<Xs...>();
+	}
+
+	template<typename C>
+	void add_term(signature_filter&, reflecs::filters::optional<C>*)
+	{
+		static_assert(reflecs::type_utils::get_component_type_id<C, Cs...>() != size_t(-1), "Optional component is not registered");
+	}
+
+	template<typename ... Xs>
+	void add_term(signature_filter& filter, reflecs::filters::any_of<Xs...>*)
+	{
+		filter.any_of.push_back(create_signature<Xs...>());
+	}
+
+	/**
+	* @brief Argument passed for a query term: a handle for components, a std::optional
+	*		 handle for optional terms, which is empty if the entity lacks the component
+	*
+	* @tparam T Component or filters::optional term
+	*/
+	template<typename T>
+	auto term_handle(entity_id e_id)
+	{
+		if constexpr (reflecs::filters::is_optional<T>::value)
+		{
+			using C = typename T::component;
+			using handle = decltype(create_handle<C>(e_id));
+
+			constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+			if (m_entity_records[reflecs::entity_utils::index_of(e_id)].signature.test(component_id))
+			{
+				return std::optional<handle>(create_handle<C>(e_id));
+			}
+			return std::optional<handle>();
+		}
+		else
+		{
+			return create_handle<T>(e_id);
+		}
+	}
+
+	/// Arguments of a query term; empty for terms that only filter
+	template<typename T>
+	auto term_arguments(entity_id e_id)
+	{
+		if constexpr (reflecs::filters::is_filter<T>::value)
+		{
+			return std::tuple<>();
+		}
+		else
+		{
+			return std::make_tuple(term_handle<T>(e_id));
+		}
+	}
+
+	/**
+	* @brief Invokes the function as function(e_id, leading..., arguments of the terms Ts...)
+	*
+	* @tparam ...Ts Query terms
+	* @param function Function object (lambda/functor)
+	* @param e_id Entity's ID
+	* @param leading Arguments passed before those of the terms
+	*/
+	template<typename ... Ts, typename F, typename ... Leading>
+	void invoke_terms(F& function, entity_id e_id, Leading&& ... leading)
+	{
+		if constexpr ((reflecs::filters::is_filter<Ts>::value || ...))
+		{
+			std::apply(function, std::tuple_cat(std::forward_as_tuple(e_id, std::forward<Leading>(leading)...), term_arguments<Ts>(e_id)...));
+		}
+		else
+		{
+			function(e_id, std::forward<Leading>(leading)..., term_handle<Ts>(e_id)...);
+		}
+	}
+
+	/**
+	 * @brief Number of instances stored contiguously in every pool starting at the chunk's first instances
+	 * @tparam ...Ts Components
+	 * @param first_instances Instances of the first entity in the chunk
+	*/
+	template<typename ... Ts, size_t ... indices>
+	size_t contiguous_instances(const std::array<component_instance, sizeof...(Ts)>& first_instances, std::index_sequence<indices...>)
+	{
+		return std::min({ retrieve_pool<Ts>().contiguous_instances(first_instances[indices])... });
+	}
+
+	/**
+	 * @brief Checks whether the entity's instances directly follow a chunk in every pool; tags always follow
+	 * @tparam ...Ts Components
+	 * @param e_id Entity's ID
+	 * @param first_instances Instances of the first entity in the chunk
+	 * @param offset Position of the entity inside the chunk
+	*/
+	template<typename ... Ts, size_t ... indices>
+	bool instances_follow(entity_id e_id, const std::array<component_instance, sizeof...(Ts)>& first_instances, size_t offset, std::index_sequence<indices...>)
+	{
+		size_t index = reflecs::entity_utils::index_of(e_id);
+		return ((reflecs::component_reflection::is_tag<Ts>::value || retrieve_pool<Ts>().look_up(index) == first_instances[indices] + offset) && ...);
+	}
+
+	/**
+	 * @brief Invokes the chunk function with the field addresses of every component and the chunk length
+	 * @tparam ...Ts Components
+	 * @param function Function object (lambda/functor)
+	 * @param first_instances Instances of the first entity in the chunk
+	 * @param count Number of entities in the chunk
+	*/
+	template<typename ... Ts, typename F, size_t ... indices>
+	void invoke_chunk(F& function, const std::array<component_instance, sizeof...(Ts)>& first_instances, size_t count, std::index_sequence<indices...>)
+	{
+		std::apply(function, std::tuple_cat(retrieve_pool<Ts>().get_member_pointers(first_instances[indices])..., std::make_tuple(count)));
+	}
+
+	/**
+	 * @brief Resolves the field base pointers of a run once and invokes the function for every row.
+	 *		  Writable views of change tracked components mark the whole run as changed.
+	 * @tparam ...Ts Components, optionally const
+	 * @param function Function object (lambda/functor)
+	 * @param entities First entity of the run
+	 * @param first_instances Instances of the first entity in the run
+	 * @param count Number of entities in the run
+	*/
+	template<typename ... Ts, typename F, size_t ... indices>
+	void invoke_views(F& function, const entity_id* entities, const std::array<component_instance, sizeof...(Ts)>& first_instances, size_t count, std::index_sequence<indices...>)
+	{
+		std::apply([&](auto* ... fields)
+			{
+				run_views<Ts...>(function, entities, count, std::index_sequence_for<Ts...>(), fields...);
+			}, std::tuple_cat(component_view<Ts>::resolve(retrieve_pool<std::remove_const_t<Ts>>(), first_instances[indices])...)
+		);
+
+		(mark_run_changed<Ts>(first_instances[indices], count), ...);
+	}
+
+	/**
+	 * @brief Row loop of a run. The field base pointers of every component arrive as restrict
+	 *		  parameters, where compilers reliably honor restrict, so the loop is vectorized
+	 *		  without runtime alias checks; the views get their blocks cut from them.
+	 * @tparam ...Ts Components, optionally const
+	 * @param function Function object (lambda/functor)
+	 * @param entities First entity of the run
+	 * @param count Number of entities in the run
+	 * @param fields Field base pointers of every component, in the order of Ts
+	*/
+	template<typename ... Ts, typename F, size_t ... indices, typename ... Fields>
+	static void run_views(F& function, const entity_id* entities, size_t count, std::index_sequence<indices...>, Fields* REFLECS_RESTRICT ... fields)
+	{
+		constexpr size_t member_counts[] = { reflecs::component_reflection::get_member_count<std::remove_const_t<Ts>>::count..., 0 };
+
+		std::tuple<Fields*...> all_fields(fields...);
+		std::tuple<typename component_view<Ts>::block...> blocks(slice_block<Ts, first_field(member_counts, indices)>(all_fields, std::make_index_sequence<member_counts[indices]>())...);
+
+		for (size_t row = 0; row < count; ++row)
+		{
+			function(entities[row], component_view<Ts>(std::get<indices>(blocks), row)...);
+		}
+	}
+
+	/// Position of a component's first field among the fields of all components
+	static constexpr size_t first_field(const size_t* member_counts, size_t component)
+	{
+		size_t first = 0;
+		for (size_t i = 0; i < component; ++i)
+		{
+			first += member_counts[i];
+		}
+		return first;
+	}
+
+	/**
+	 * @brief Cuts the block of a component out of the field pointers of all components
+	 * @tparam T Component, optionally const
+	 * @tparam first Position of the component's first field
+	 * @param all_fields Field base pointers of every component
+	*/
+	template<typename T, size_t first, typename Fields, size_t ... fields>
+	static typename component_view<T>::block slice_block(const Fields& all_fields, std::index_sequence<fields...>)
+	{
+		return typename component_view<T>::block(std::get<first + fields>(all_fields)...);
+	}
+
+	/**
+	 * @brief Marks a run of instances as changed if the component was writable and is tracked or indexed
+	 * @tparam T Component, optionally const
+	 * @param first First instance of the run
+	 * @param count Number of instances
+	*/
+	template<typename T>
+	void mark_run_changed(component_instance first, size_t count)
+	{
+		if constexpr (!std::is_const<T>::value && (reflecs::component_reflection::track_changes<T>::value || reflecs::component_reflection::has_range_index<std::remove_const_t<T>>::value))
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				retrieve_pool<T>().mark_changed(first + i);
+			}
+		}
+	}
+
+	/**
+	 * @brief Returns a pointer to the pool of a component's type
+	 * @tparam C Component
+	 * @return Component pool pointer; a tag_manager for tags
+	*/
+	template<typename C>
+	component_storage<C>& retrieve_pool()
+	{
+		return std::get<component_storage<C>>(m_component_pools);
+	}
+
+	/**
+	 * @brief Occupancy of a component's pool; tags are counted from the buckets holding them
+	 * @tparam C Component
+	*/
+	template<typename C>
+	reflecs::instrumentation::pool_stats describe_pool()
+	{
+		if constexpr (reflecs::component_reflection::is_tag<C>::value)
+		{
+			constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+
+			size_t instances = 0;
+			for (const signature_bucket& bucket : m_buckets)
+			{
+				instances += bucket.signature[component_id] ? bucket.entities.size() : 0;
+			}
+			return { instances, 0 };
+		}
+		else
+		{
+			component_manager<C>& pool = retrieve_pool<C>();
+			return { pool.size(), pool.resident_bytes() };
+		}
+	}
+
+	/**
+	 * @brief Compile-time helper method to remove the entity from assigned pool
+	 * @tparam Position of a bit in a bit_mask
+	 * @param e_index Entity's slot index
+	 * @param bit_mask Entity's bit mask
+	*/
+	template<size_t index>
+	void remove_entity_from_pool(size_t e_index, bit_mask& bit_mask)
+	{
+		using C = reflecs::type_utils::component_type_at_index<index, Cs...>;
+
+		if (bit_mask[index])
+		{
+			if constexpr (!reflecs::component_reflection::is_tag<C>::value)
+			{
+				std::lock_guard<reflecs::concurrency::mutex> pool_lock(m_pool_locks[index]);
+				retrieve_pool<C>().remove(e_index);
+			}
+			record_stats([](auto& counters) { counters.removes[index].add(1); });
 		}
 	}
 
@@ -221,9 +2774,9 @@ private:
 	template<size_t index>
 	struct remove_entity_wrapper
 	{
-		void operator()(registry* parent, entity_id e_id, bit_mask& bit_mask)
+		void operator()(registry* parent, size_t e_index, bit_mask& bit_mask)
 		{
-			parent->remove_entity_from_pool<index>(e_id, bit_mask);
+			parent->remove_entity_from_pool<index>(e_index, bit_mask);
 		}
 	};
 };
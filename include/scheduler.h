@@ -0,0 +1,229 @@
+#pragma once
+#include "registry.h"
+#include <string>
+
+namespace reflecs
+{
+	namespace scheduling
+	{
+		/// Single field of a component, for declaring access finer than the whole component
+		template<typename C, size_t index>
+		struct field {};
+
+		/// Components or fields a system reads
+		template<typename ... Ts>
+		struct reads {};
+
+		/// Components or fields a system writes
+		template<typename ... Ts>
+		struct writes {};
+	}
+}
+
+
+/**
+ * @class scheduler
+ *
+ * @brief Runs systems that declare which components or fields they read and write.
+ *		  Every system depends on the earlier registered systems it conflicts with, i.e. one
+ *		  of them writes a column the other one reads or writes. Systems are grouped into
+ *		  levels by their longest dependency chain; the systems of a level run in parallel
+ *		  on the thread pool, so systems touching disjoint columns overlap automatically.
+ *		  Handles stamp components that track changes or have range indices on every access,
+ *		  so any access to such a component also writes its stamp column and orders the systems.
+ *
+ *		  Systems must not add, remove or destroy directly, but record into registry::commands();
+ *		  run() flushes once every system has finished.
+ *
+ * @tparam Cs Components registered in the registry
+ */
+template<typename ... Cs>
+class scheduler
+{
+private:
+	using system_function = std::function<void(registry<Cs...>&)>;
+
+	/// Whether handles stamp the component on access: change tracking writes its versions, range indices their stale flags
+	template<typename C>
+	static constexpr bool stamps()
+	{
+		return reflecs::component_reflection::track_changes<C>::value || reflecs::component_reflection::has_range_index<C>::value;
+	}
+
+	/// Columns a component contributes to the access sets: its fields, plus a stamp column if handles stamp it
+	template<typename C>
+	static constexpr size_t column_count()
+	{
+		return reflecs::component_reflection::get_member_count<C>::count + stamps<C>();
+	}
+
+	static constexpr size_t m_column_count = (column_count<Cs>() + ...);
+
+	using access_set = std::bitset<m_column_count>;
+
+	struct system
+	{
+		std::string name;
+		system_function function;
+		access_set reads; // Includes the written columns
+		access_set writes;
+		std::vector<size_t> dependencies; // Earlier systems that must finish first
+		size_t level = 0;
+	};
+
+	registry<Cs...>& m_registry;
+	thread_pool& m_pool;
+	std::vector<system> m_systems; // In registration order
+	std::vector<std::vector<size_t>> m_levels; // Systems per level; a level starts once the previous one finished
+
+public:
+
+	scheduler(registry<Cs...>& owner, thread_pool& pool)
+		: m_registry(owner)
+		, m_pool(pool)
+	{
+	}
+
+	/**
+	 * @brief Registers a system, e.g.
+	 *		  add<reads<velocity>, writes<transform>>("movement", function) or
+	 *		  add<reads<>, writes<reflecs::scheduling::field<transform, 0>>>("slide", function)
+	 *
+	 * @tparam Reads reflecs::scheduling::reads of components or fields
+	 * @tparam Writes reflecs::scheduling::writes of components or fields
+	 * @param name Name used for inspection
+	 * @param function Invoked as function(registry)
+	 * @return Index of the system
+	 */
+	template<typename Reads, typename Writes, typename F>
+	size_t add(std::string name, F&& function)
+	{
+		system s;
+		s.name = std::move(name);
+		s.function = std::forward<F>(function);
+		s.reads = collect(Reads()) | collect(Writes());
+		s.writes = collect(Writes()) | (s.reads & stamp_columns()); // Reading through a handle still stamps
+
+		for (size_t i = 0; i < m_systems.size(); ++i)
+		{
+			const system& earlier = m_systems[i];
+			if ((earlier.writes & s.reads).any() || (s.writes & earlier.reads).any())
+			{
+				s.dependencies.push_back(i);
+				s.level = std::max(s.level, earlier.level + 1);
+			}
+		}
+
+		if (s.level == m_levels.size())
+		{
+			m_levels.emplace_back();
+		}
+		m_levels[s.level].push_back(m_systems.size());
+		m_systems.push_back(std::move(s));
+		return m_systems.size() - 1;
+	}
+
+	/// Runs every system once, level by level, then applies the recorded commands
+	void run()
+	{
+		for (const std::vector<size_t>& level : m_levels)
+		{
+			m_pool.parallel_for(level.size(), 1, [this, &level](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; ++i)
+					{
+						m_systems[level[i]].function(m_registry);
+					}
+				}
+			);
+		}
+		m_registry.flush();
+	}
+
+	/// Number of registered systems
+	size_t size() const
+	{
+		return m_systems.size();
+	}
+
+	/// Name of a system
+	const std::string& name(size_t system) const
+	{
+		return m_systems[system].name;
+	}
+
+	/// Earlier systems the system waits for
+	const std::vector<size_t>& dependencies(size_t system) const
+	{
+		return m_systems[system].dependencies;
+	}
+
+	/// Systems grouped by the level they run in
+	const std::vector<std::vector<size_t>>& levels() const
+	{
+		return m_levels;
+	}
+
+private:
+
+	/// Index of the first column of a component
+	template<typename C>
+	static constexpr size_t first_column()
+	{
+		constexpr size_t component_id = reflecs::type_utils::get_component_type_id<C, Cs...>();
+		constexpr size_t counts[] = { column_count<Cs>()... };
+
+		size_t column = 0;
+		for (size_t i = 0; i < component_id; ++i)
+		{
+			column += counts[i];
+		}
+		return column;
+	}
+
+	/// Stamp columns of every component
+	static access_set stamp_columns()
+	{
+		access_set columns;
+		(add_stamp_column<Cs>(columns), ...);
+		return columns;
+	}
+
+	template<typename C>
+	static void add_stamp_column(access_set& columns)
+	{
+		if constexpr (stamps<C>())
+		{
+			columns.set(first_column<C>() + reflecs::component_reflection::get_member_count<C>::count);
+		}
+	}
+
+	/// Builds the access set of a reads<...> or writes<...> list
+	template<template<typename...> typename List, typename ... Ts>
+	static access_set collect(List<Ts...>)
+	{
+		access_set columns;
+		(add_columns(columns, static_cast<Ts*>(nullptr)), ...);
+		return columns;
+	}
+
+	/// Every column of a component
+	template<typename C>
+	static void add_columns(access_set& columns, C*)
+	{
+		for (size_t i = 0; i < column_count<C>(); ++i)
+		{
+			columns.set(first_column<C>() + i);
+		}
+	}
+
+	/// A single field's column, plus the component's stamp column since any access stamps it
+	template<typename C, size_t index>
+	static void add_columns(access_set& columns, reflecs::scheduling::field<C, index>*)
+	{
+		static_assert(index < reflecs::component_reflection::get_member_count<C>::count, "Field index is out of range");
+
+		columns.set(first_column<C>() + index);
+		add_stamp_column<C>(columns);
+	}
+};
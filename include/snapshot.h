@@ -0,0 +1,334 @@
+#pragma once
+#include "common.h"
+#include "page_allocator.h"
+#include <cstdio>
+#include <memory>
+#include <new>
+
+namespace reflecs
+{
+	namespace snapshot
+	{
+		constexpr std::uint32_t g_magic = 0x53434652; // "RFCS" read as little endian
+		constexpr std::uint32_t g_version = 5;
+		constexpr size_t g_alignment = 4096; // Alignment of the sections that are adopted without copying
+
+		/// First bytes of every snapshot; identifies the file and the registry layout it was written from
+		struct header
+		{
+			std::uint32_t magic = g_magic;
+			std::uint32_t version = g_version;
+			std::uint64_t components = 0; // Number of registered components
+			std::uint64_t page_size = g_page_size;
+			std::uint64_t entities = 0; // Number of entity slots ever handed out
+			std::uint64_t free_head = 0; // Head of the entity free list
+			std::uint64_t tick = 0; // Change tracking tick of the registry
+		};
+
+		/**
+		 * @class writer
+		 *
+		 * @brief Appends sections to a snapshot file and pads them to the required alignment
+		 */
+		class writer
+		{
+		private:
+			std::FILE* m_file;
+			size_t m_offset = 0; // Bytes written so far
+			bool m_ok; // Cleared by the first failed write
+
+		public:
+			explicit writer(const char* path)
+				: m_file(std::fopen(path, "wb"))
+				, m_ok(m_file != nullptr)
+			{
+			}
+
+			~writer()
+			{
+				if (m_file)
+				{
+					std::fclose(m_file);
+				}
+			}
+
+			writer(const writer&) = delete;
+			writer& operator=(const writer&) = delete;
+
+			/// Whether every write so far succeeded
+			bool ok() const
+			{
+				return m_ok;
+			}
+
+			/**
+			 * @brief Flushes and closes the file
+			 * @param durable Also wait until the contents reached the disk, where the platform allows it
+			 */
+			bool close(bool durable = false)
+			{
+				if (m_file)
+				{
+#if REFLECS_HAS_MMAP
+					if (durable)
+					{
+						m_ok = std::fflush(m_file) == 0 && fsync(fileno(m_file)) == 0 && m_ok;
+					}
+#else
+					(void)durable;
+#endif
+					m_ok = std::fclose(m_file) == 0 && m_ok;
+					m_file = nullptr;
+				}
+				return m_ok;
+			}
+
+			/**
+			 * @brief Writes raw bytes
+			 * @param data Bytes to write
+			 * @param bytes Number of bytes
+			 */
+			void write(const void* data, size_t bytes)
+			{
+				if (m_ok && bytes > 0)
+				{
+					m_ok = std::fwrite(data, 1, bytes, m_file) == bytes;
+				}
+				m_offset += bytes;
+			}
+
+			/// Writes a trivially copyable value
+			template<typename T>
+			void write_value(const T& value)
+			{
+				write(&value, sizeof(T));
+			}
+
+			/// Pads the file with zeros up to the next multiple of alignment
+			void align(size_t alignment = g_alignment)
+			{
+				static const char zeros[g_alignment] = {};
+				size_t padding = (alignment - m_offset % alignment) % alignment;
+				write(zeros, padding);
+			}
+		};
+
+		/**
+		 * @class mapping
+		 *
+		 * @brief Read-only view of a whole snapshot file. Where available the file is mapped
+		 *		  privately, so adopted pages are loaded on first access and copied on first write;
+		 *		  elsewhere it is read into an aligned buffer.
+		 */
+		class mapping
+		{
+		private:
+			char* m_data = nullptr;
+			size_t m_size = 0;
+			bool m_mapped = false; // Whether m_data comes from mmap
+
+			mapping() = default;
+
+		public:
+			~mapping()
+			{
+#if REFLECS_HAS_MMAP
+				if (m_mapped)
+				{
+					munmap(m_data, m_size);
+					return;
+				}
+#endif
+				::operator delete(m_data, std::align_val_t(g_alignment));
+			}
+
+			mapping(const mapping&) = delete;
+			mapping& operator=(const mapping&) = delete;
+
+			/**
+			 * @brief Maps a file
+			 * @param path File path
+			 * @return The mapping or nullptr if the file could not be opened
+			 */
+			static std::shared_ptr<mapping> open(const char* path)
+			{
+				std::shared_ptr<mapping> file(new mapping());
+#if REFLECS_HAS_MMAP
+				int descriptor = ::open(path, O_RDONLY);
+				if (descriptor < 0)
+				{
+					return nullptr;
+				}
+
+				struct stat info;
+				if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+				{
+					::close(descriptor);
+					return nullptr;
+				}
+
+				void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+				::close(descriptor);
+				if (data == MAP_FAILED)
+				{
+					return nullptr;
+				}
+
+				file->m_data = static_cast<char*>(data);
+				file->m_size = info.st_size;
+				file->m_mapped = true;
+#else
+				std::FILE* stream = std::fopen(path, "rb");
+				if (!stream)
+				{
+					return nullptr;
+				}
+
+				std::fseek(stream, 0, SEEK_END);
+				long size = std::ftell(stream);
+				std::fseek(stream, 0, SEEK_SET);
+				if (size <= 0)
+				{
+					std::fclose(stream);
+					return nullptr;
+				}
+
+				file->m_size = size;
+				file->m_data = static_cast<char*>(::operator new(file->m_size, std::align_val_t(g_alignment)));
+				bool complete = std::fread(file->m_data, 1, file->m_size, stream) == file->m_size;
+				std::fclose(stream);
+				if (!complete)
+				{
+					return nullptr;
+				}
+#endif
+				return file;
+			}
+
+			char* data() const
+			{
+				return m_data;
+			}
+
+			size_t size() const
+			{
+				return m_size;
+			}
+		};
+
+		/**
+		 * @class reader
+		 *
+		 * @brief Walks the sections of a mapped snapshot. Small values are copied out,
+		 *		  large sections are handed out as pointers into the mapping.
+		 */
+		class reader
+		{
+		private:
+			std::shared_ptr<mapping> m_file;
+			size_t m_offset = 0; // Bytes consumed so far
+
+		public:
+			explicit reader(std::shared_ptr<mapping> file)
+				: m_file(std::move(file))
+			{
+			}
+
+			/// The mapping; pages adopted from it keep it alive
+			const std::shared_ptr<mapping>& file() const
+			{
+				return m_file;
+			}
+
+			/**
+			 * @brief Hands out the next bytes without copying them
+			 * @param bytes Number of bytes
+			 * @return Pointer into the mapping or nullptr if the file is too short
+			 */
+			char* take(size_t bytes)
+			{
+				if (bytes > m_file->size() - m_offset)
+				{
+					return nullptr;
+				}
+
+				char* data = m_file->data() + m_offset;
+				m_offset += bytes;
+				return data;
+			}
+
+			/**
+			 * @brief Copies the next bytes out of the mapping
+			 * @param data Receives the bytes
+			 * @param bytes Number of bytes
+			 * @return False if the file is too short
+			 */
+			bool read(void* data, size_t bytes)
+			{
+				const char* source = take(bytes);
+				if (!source)
+				{
+					return false;
+				}
+				std::memcpy(data, source, bytes);
+				return true;
+			}
+
+			/// Reads a trivially copyable value
+			template<typename T>
+			bool read_value(T& value)
+			{
+				return read(&value, sizeof(T));
+			}
+
+			/// Skips the padding written by writer::align()
+			bool align(size_t alignment = g_alignment)
+			{
+				return take((alignment - m_offset % alignment) % alignment) != nullptr;
+			}
+		};
+
+		/**
+		 * @brief Writes a bit set as 64-bit words
+		 * @param out Snapshot writer
+		 * @param bits Bit set
+		 */
+		template<size_t N>
+		void write_bits(writer& out, const std::bitset<N>& bits)
+		{
+			for (size_t word = 0; word < (N + 63) / 64; ++word)
+			{
+				std::uint64_t value = 0;
+				for (size_t bit = word * 64; bit < std::min(N, word * 64 + 64); ++bit)
+				{
+					value |= std::uint64_t(bits[bit]) << (bit - word * 64);
+				}
+				out.write_value(value);
+			}
+		}
+
+		/**
+		 * @brief Reads a bit set written by write_bits()
+		 * @param in Snapshot reader
+		 * @param bits Receives the bit set
+		 */
+		template<size_t N>
+		bool read_bits(reader& in, std::bitset<N>& bits)
+		{
+			bits.reset();
+			for (size_t word = 0; word < (N + 63) / 64; ++word)
+			{
+				std::uint64_t value;
+				if (!in.read_value(value))
+				{
+					return false;
+				}
+				for (size_t bit = word * 64; bit < std::min(N, word * 64 + 64); ++bit)
+				{
+					bits[bit] = (value >> (bit - word * 64)) & 1;
+				}
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,271 @@
+#pragma once
+#include "common.h"
+#include "snapshot.h"
+
+
+/**
+ * @class sparse_map
+ *
+ * @brief Open-addressing hash map from entity slot indices to elements, with the same
+ *		  interface as paged_array. Its memory follows the number of stored elements
+ *		  instead of the range of indices they are spread over, which suits components
+ *		  only a few entities have. Collisions are resolved by linear probing and erased
+ *		  slots are filled by shifting the rest of their probe sequence back, so no
+ *		  tombstones pile up. References are invalidated by acquire() and release().
+ *
+ *		  get() and find() may be called from several threads at once while nothing is
+ *		  acquired or released.
+ *
+ * @tparam T Element type
+ */
+template<typename T>
+class sparse_map
+{
+private:
+	static constexpr std::uint32_t m_empty_key = -1; // Marks unused slots
+	static constexpr size_t m_min_slots = 16;
+
+	struct slot
+	{
+		std::uint32_t key = m_empty_key;
+		T value = T();
+	};
+
+	size_t m_capacity; // Maximum index plus one
+	size_t m_size = 0; // Number of stored elements
+	std::vector<slot> m_slots; // Power of two sized table; empty until the first element is stored
+
+public:
+
+	/**
+	 * @brief Creates an empty map
+	 * @param capacity Maximum index plus one
+	*/
+	explicit sparse_map(size_t capacity = 0)
+		: m_capacity(std::min<size_t>(capacity, m_empty_key))
+	{
+	}
+
+	sparse_map(const sparse_map&) = delete;
+	sparse_map& operator=(const sparse_map&) = delete;
+
+	/// Maximum index plus one
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+	/// Number of stored elements
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	/// Bytes held by the table
+	size_t resident_bytes() const
+	{
+		return m_slots.capacity() * sizeof(slot);
+	}
+
+	/**
+	 * @brief Writes the stored elements as index and value pairs
+	 * @param out Snapshot writer
+	*/
+	void save(reflecs::snapshot::writer& out) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only maps of trivially copyable elements can be saved");
+
+		out.write_value(std::uint64_t(m_size));
+		for (const slot& s : m_slots)
+		{
+			if (s.key != m_empty_key)
+			{
+				out.write_value(std::uint64_t(s.key));
+				out.write_value(s.value);
+			}
+		}
+	}
+
+	/**
+	 * @brief Restores the elements written by save(); the map must be empty
+	 * @param in Snapshot reader
+	 * @return False if the snapshot does not fit the map
+	*/
+	bool load(reflecs::snapshot::reader& in)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only maps of trivially copyable elements can be loaded");
+
+		std::uint64_t size;
+		if (!in.read_value(size) || size > m_capacity)
+		{
+			return false;
+		}
+
+		reserve(size);
+		for (std::uint64_t i = 0; i < size; ++i)
+		{
+			std::uint64_t index;
+			T value;
+			if (!in.read_value(index) || !in.read_value(value) || index >= m_capacity || find(index))
+			{
+				return false;
+			}
+			acquire(index) = value;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Accesses an element that is known to be stored
+	 * @param index Element index
+	*/
+	T& operator[](size_t index)
+	{
+		T* element = find(index);
+		assert(element && "index is not stored");
+		return *element;
+	}
+
+	const T& operator[](size_t index) const
+	{
+		return *find(index);
+	}
+
+	/**
+	 * @brief Returns the element's address or nullptr if it is not stored
+	 * @param index Element index
+	*/
+	T* find(size_t index) const
+	{
+		if (m_size == 0 || index >= m_capacity)
+		{
+			return nullptr;
+		}
+
+		size_t mask = m_slots.size() - 1;
+		for (size_t i = home_of(index); ; i = (i + 1) & mask)
+		{
+			const slot& s = m_slots[i];
+			if (s.key == index)
+			{
+				return const_cast<T*>(&s.value);
+			}
+			if (s.key == m_empty_key)
+			{
+				return nullptr;
+			}
+		}
+	}
+
+	/**
+	 * @brief Reads an element, falling back to a value-initialized T if it is not stored
+	 * @param index Element index
+	*/
+	T get(size_t index) const
+	{
+		T* element = find(index);
+		return element ? *element : T();
+	}
+
+	/**
+	 * @brief Stores a value-initialized element, growing the table once it is half full
+	 * @param index Element index; must not be stored yet
+	 * @return Reference to the element
+	*/
+	T& acquire(size_t index)
+	{
+		assert(index < m_capacity && "index is out of range");
+		assert(!find(index) && "index is already stored");
+
+		reserve(m_size + 1);
+		m_size++;
+		return insert(static_cast<std::uint32_t>(index)).value;
+	}
+
+	/**
+	 * @brief Erases the element and shrinks the table once it is less than an eighth full
+	 * @param index Element index
+	*/
+	void release(size_t index)
+	{
+		assert(find(index) && "index was not acquired");
+
+		size_t mask = m_slots.size() - 1;
+		size_t hole = home_of(index);
+		while (m_slots[hole].key != index)
+		{
+			hole = (hole + 1) & mask;
+		}
+
+		/// Move every later element of the probe sequence that may live in the hole into it
+		for (size_t i = (hole + 1) & mask; m_slots[i].key != m_empty_key; i = (i + 1) & mask)
+		{
+			size_t home = home_of(m_slots[i].key);
+			if (((i - home) & mask) >= ((i - hole) & mask))
+			{
+				m_slots[hole] = m_slots[i];
+				hole = i;
+			}
+		}
+		m_slots[hole] = slot();
+		m_size--;
+
+		if (m_size == 0)
+		{
+			std::vector<slot>().swap(m_slots);
+		}
+		else if (m_slots.size() > m_min_slots && m_size * 8 < m_slots.size())
+		{
+			rehash(m_slots.size() / 2);
+		}
+	}
+
+private:
+
+	/// Preferred slot of an index; Fibonacci hashing spreads consecutive indices over the table
+	size_t home_of(size_t index) const
+	{
+		return static_cast<size_t>((std::uint64_t(index) * 0x9E3779B97F4A7C15ull) >> 32) & (m_slots.size() - 1);
+	}
+
+	/// Grows the table so it stays at most half full with the given number of elements
+	void reserve(size_t size)
+	{
+		size_t slots = std::max(m_slots.size(), m_min_slots);
+		while (size * 2 > slots)
+		{
+			slots *= 2;
+		}
+		if (slots != m_slots.size())
+		{
+			rehash(slots);
+		}
+	}
+
+	/// Moves every element into a table of the given power of two size
+	void rehash(size_t slots)
+	{
+		std::vector<slot> old(slots);
+		old.swap(m_slots);
+		for (const slot& s : old)
+		{
+			if (s.key != m_empty_key)
+			{
+				insert(s.key).value = s.value;
+			}
+		}
+	}
+
+	/// Claims the first free slot of the key's probe sequence
+	slot& insert(std::uint32_t key)
+	{
+		size_t mask = m_slots.size() - 1;
+		size_t i = home_of(key);
+		while (m_slots[i].key != m_empty_key)
+		{
+			i = (i + 1) & mask;
+		}
+		m_slots[i].key = key;
+		return m_slots[i];
+	}
+};
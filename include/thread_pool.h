@@ -0,0 +1,244 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+/**
+ * @class thread_pool
+ *
+ * @brief Work-stealing thread pool used by the parallel iteration APIs.
+ *		  Every worker owns a task deque; it pops work from the back of its own deque
+ *		  and steals from the front of the other workers' deques once it runs dry.
+ *		  The pool is meant to be created once and reused across ticks.
+ */
+class thread_pool
+{
+private:
+	using task = std::function<void()>;
+
+	struct worker_queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	std::vector<std::thread> m_workers;
+	std::vector<std::unique_ptr<worker_queue>> m_queues; // One queue per worker
+	std::atomic<size_t> m_queued_tasks = 0; // Tasks waiting in any of the queues
+	std::atomic<size_t> m_next_queue = 0; // Round-robin cursor for tasks submitted from outside the pool
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_wake_up;
+	bool m_stop = false;
+
+	static inline thread_local thread_pool* t_owner = nullptr; // Pool the current thread works for
+	static inline thread_local size_t t_worker_index = 0; // Index of the current worker within its pool
+
+public:
+
+	/**
+	 * @brief Spawns the workers
+	 * @param worker_count Number of worker threads; 0 picks the hardware concurrency
+	*/
+	explicit thread_pool(size_t worker_count = 0)
+	{
+		if (worker_count == 0)
+		{
+			worker_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+		}
+
+		for (size_t i = 0; i < worker_count; ++i)
+		{
+			m_queues.push_back(std::make_unique<worker_queue>());
+		}
+		for (size_t i = 0; i < worker_count; ++i)
+		{
+			m_workers.emplace_back([this, i]() { worker_loop(i); });
+		}
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleep_mutex);
+			m_stop = true;
+		}
+		m_wake_up.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	/// Number of worker threads owned by the pool
+	size_t worker_count() const
+	{
+		return m_workers.size();
+	}
+
+	/**
+	 * @brief Splits [0, count) into ranges of at most grain_size elements and runs them on the pool.
+	 *		  The calling thread helps executing tasks until every range has been processed,
+	 *		  which also makes nested calls from inside a task safe.
+	 *
+	 * @tparam F Function type
+	 * @param count Number of elements
+	 * @param grain_size Maximum number of elements per task
+	 * @param function Function object invoked as function(begin, end)
+	*/
+	template<typename F>
+	void parallel_for(size_t count, size_t grain_size, F&& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		grain_size = std::max<size_t>(1, grain_size);
+		size_t task_count = (count + grain_size - 1) / grain_size;
+
+		/// Not worth waking the workers for a single range
+		if (task_count == 1)
+		{
+			function(size_t(0), count);
+			return;
+		}
+
+		std::atomic<size_t> pending = task_count;
+		for (size_t begin = 0; begin < count; begin += grain_size)
+		{
+			size_t end = std::min(begin + grain_size, count);
+			push([&function, &pending, begin, end]()
+				{
+					function(begin, end);
+					pending.fetch_sub(1, std::memory_order_release);
+				}
+			);
+		}
+		wake_workers();
+
+		/// Help out until all of our tasks are finished
+		while (pending.load(std::memory_order_acquire) > 0)
+		{
+			if (!run_one(t_owner == this ? t_worker_index : 0))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+private:
+
+	/// Wakes sleeping workers; taking the sleep mutex first guarantees no worker misses the notification
+	void wake_workers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		}
+		m_wake_up.notify_all();
+	}
+
+	/**
+	 * @brief Queues a task; workers push to their own deque, other threads distribute round-robin
+	 * @param t Task to queue
+	*/
+	void push(task&& t)
+	{
+		size_t index = t_owner == this ? t_worker_index : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+		worker_queue& queue = *m_queues[index];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(std::move(t));
+		}
+		m_queued_tasks.fetch_add(1, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Executes a single task, preferring the given queue and stealing from the others
+	 * @param home Index of the queue to look into first
+	 * @return Whether a task was executed
+	*/
+	bool run_one(size_t home)
+	{
+		task t;
+		if (!pop(home, t))
+		{
+			return false;
+		}
+		t();
+		return true;
+	}
+
+	/**
+	 * @brief Takes the newest task from the home queue or steals the oldest one from another queue
+	 * @param home Index of the queue to look into first
+	 * @param t Receives the task
+	 * @return Whether a task was found
+	*/
+	bool pop(size_t home, task& t)
+	{
+		if (m_queued_tasks.load(std::memory_order_acquire) == 0)
+		{
+			return false;
+		}
+
+		size_t queue_count = m_queues.size();
+		for (size_t i = 0; i < queue_count; ++i)
+		{
+			worker_queue& queue = *m_queues[(home + i) % queue_count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+			{
+				continue;
+			}
+
+			if (i == 0)
+			{
+				t = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				t = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			m_queued_tasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Worker main loop; runs tasks while there are any and sleeps otherwise
+	 * @param index Index of the worker
+	*/
+	void worker_loop(size_t index)
+	{
+		t_owner = this;
+		t_worker_index = index;
+
+		while (true)
+		{
+			if (run_one(index))
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleep_mutex);
+			m_wake_up.wait(lock, [this]() { return m_stop || m_queued_tasks.load(std::memory_order_acquire) > 0; });
+			if (m_stop)
+			{
+				return;
+			}
+		}
+	}
+};
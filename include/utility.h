@@ -55,7 +55,81 @@ namespace reflecs
 		/// Used to get the handle to the member within the pool
 		template<typename T, size_t N>
 		typename get_pointer_to_member_type<T, N>::type get_pointer_to_member() {};
+
+		/// Components declared with a member count of 0 are tags; they only exist as a bit in the entity's signature
+		template<typename ComponentType>
+		struct is_tag : std::bool_constant<get_member_count<ComponentType>::count == 0> {};
+
+		/// Opt-in change tracking; specialize as std::true_type to stamp every write with the registry's tick
+		template<typename ComponentType>
+		struct track_changes : std::false_type {};
+
+		/// Opt-in sorted index over a field; specialize as std::true_type to enable registry::query_range on it
+		template<typename ComponentType, size_t N>
+		struct range_index : std::false_type {};
+
+		/// Whether any field of the component has a range index
+		template<typename ComponentType, typename Indices = std::make_index_sequence<get_member_count<ComponentType>::count>>
+		struct has_range_index;
+
+		template<typename ComponentType, size_t ... indices>
+		struct has_range_index<ComponentType, std::index_sequence<indices...>> : std::bool_constant<(range_index<ComponentType, indices>::value || ...)> {};
+
+		/// Blocks of block_width instances; inside a block every field occupies its own column
+		template<size_t width>
+		struct aosoa_layout
+		{
+			static_assert(width > 0 && (width & (width - 1)) == 0 && g_page_size % width == 0, "Block width must be a power of two dividing the page size");
+			static constexpr size_t block_width = width;
+		};
+
+		/// Every field in its own column spanning the page; the default
+		using soa_layout = aosoa_layout<g_page_size>;
+
+		/// Fields of an instance stored next to each other, like an array of structs
+		using aos_layout = aosoa_layout<1>;
+
+		/// Storage layout of a component; specialize with type set to aos_layout or aosoa_layout<width> to change it
+		template<typename ComponentType>
+		struct layout
+		{
+			using type = soa_layout;
+		};
+
+		/// Entities are mapped to their instances through paged arrays; fast for components most entities have
+		struct dense_storage {};
+
+		/// Entities are mapped to their instances through a hash map whose memory follows the number of entities with the component
+		struct sparse_storage {};
+
+		/// Storage policy of a component; specialize with type set to sparse_storage for rarely attached components
+		template<typename ComponentType>
+		struct storage_policy
+		{
+			using type = dense_storage;
+		};
 	}
+	namespace entity_utils
+	{
+		/// Slot index of the entity; used to address every per-entity array
+		constexpr size_t index_of(entity_id e_id)
+		{
+			return e_id & ((entity_id(1) << g_entity_index_bits) - 1);
+		}
+
+		/// Generation of the slot at the time the entity was created
+		constexpr std::uint32_t generation_of(entity_id e_id)
+		{
+			return static_cast<std::uint32_t>(e_id >> g_entity_index_bits);
+		}
+
+		/// Packs a slot index and its generation into an entity_id
+		constexpr entity_id make_entity_id(size_t index, std::uint32_t generation)
+		{
+			return (entity_id(generation) << g_entity_index_bits) | index;
+		}
+	}
+
 	namespace type_utils
 	{
 		template<typename... Ts>